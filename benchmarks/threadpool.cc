@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+namespace
+{
+    struct Scenario
+    {
+        const char *name;
+        // submits `count` tasks to `pool`, each calls `done` once
+        std::function<void(ThreadPool &pool, size_t count, const std::function<void()> &done)> submit;
+    };
+
+    // keeps a worker busy for about `microseconds` without sleeping
+    void spin(std::chrono::microseconds microseconds)
+    {
+        auto until = std::chrono::steady_clock::now() + microseconds;
+        while (std::chrono::steady_clock::now() < until)
+            ;
+    }
+
+    // milliseconds to run `count` tasks of `scenario` on a pool of `size` threads in `mode`
+    double measure(ThreadPool::Mode mode, size_t size, size_t count, const Scenario &scenario)
+    {
+        ThreadPool pool(size, mode);
+
+        std::atomic<size_t> remaining = count;
+        auto done = [&remaining]
+        {
+            if (1 == remaining.fetch_sub(1))
+                remaining.notify_all();
+        };
+
+        auto begin = std::chrono::steady_clock::now();
+        scenario.submit(pool, count, done);
+
+        for (auto left = remaining.load(); 0 != left; left = remaining.load())
+            remaining.wait(left);
+
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = 1 < argc ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t size = 2 < argc ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency() + 3;
+
+    const Scenario scenarios[] = {
+        // every task comes from outside the pool, the shared mode serializes them on one lock
+        {"external no-op",
+         [](ThreadPool &pool, size_t count, const std::function<void()> &done)
+         {
+             for (size_t i = 0; i < count; i++)
+                 pool.submit(done);
+         }},
+        // the same with a little work per task, closer to a task resuming from a builtin
+        {"external 2us",
+         [](ThreadPool &pool, size_t count, const std::function<void()> &done)
+         {
+             for (size_t i = 0; i < count; i++)
+                 pool.submit([&done]
+                             {
+                                 spin(std::chrono::microseconds(2));
+                                 done();
+                             });
+         }},
+        // a few roots fan out from inside the workers, the stealing mode keeps them on the local queues
+        {"nested no-op",
+         [](ThreadPool &pool, size_t count, const std::function<void()> &done)
+         {
+             constexpr size_t roots = 64;
+             for (size_t root = 0; root < roots; root++)
+             {
+                 auto children = count / roots + (root < count % roots ? 1 : 0);
+                 pool.submit([&pool, &done, children]
+                             {
+                                 for (size_t i = 0; i < children; i++)
+                                     pool.submit(done);
+                             });
+             }
+         }},
+    };
+
+    std::printf("%zu tasks, %zu threads\n", count, size);
+    std::printf("%-16s %12s %12s\n", "scenario", "shared ms", "stealing ms");
+
+    for (const auto &scenario : scenarios)
+    {
+        auto shared = measure(ThreadPool::Mode::shared, size, count, scenario);
+        auto stealing = measure(ThreadPool::Mode::stealing, size, count, scenario);
+
+        std::printf("%-16s %12.1f %12.1f\n", scenario.name, shared, stealing);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "global.h"
+#include "LuaVMPool.h"
+#include "JavascriptVMPool.h"
+#include "PythonVMPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    using steady_clock = std::chrono::steady_clock;
+
+    struct Result
+    {
+        // acquiring a fresh vm
+        double startup = 0;
+        // acquiring it and reaching every module once, which binds them in the lazy mode
+        double firstUse = 0;
+    };
+
+    double microseconds(steady_clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    // the leases are kept until the end, so every acquire creates a vm instead of reusing one
+    std::vector<LuaVMPool::Lease> luaLeases;
+    std::vector<JavascriptVMPool::Lease> javascriptLeases;
+
+    Result lua(size_t count)
+    {
+        Result result;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto begin = steady_clock::now();
+            auto &lease = luaLeases.emplace_back(LuaVMPool::acquire(nullptr));
+            auto started = steady_clock::now();
+            luaL_dostring(lease.state(), "local _ = crypto, json, requests, system");
+            auto used = steady_clock::now();
+
+            result.startup += microseconds(started - begin) / count;
+            result.firstUse += microseconds(used - begin) / count;
+        }
+
+        return result;
+    }
+
+    Result javascript(size_t count)
+    {
+        Result result;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto begin = steady_clock::now();
+            auto &lease = javascriptLeases.emplace_back(JavascriptVMPool::acquire(nullptr));
+            auto started = steady_clock::now();
+            JS_FreeValue(lease.context(), JavascriptVMPool::eval(lease.context(), "crypto; json; requests; system;"));
+            auto used = steady_clock::now();
+
+            result.startup += microseconds(started - begin) / count;
+            result.firstUse += microseconds(used - begin) / count;
+        }
+
+        return result;
+    }
+
+    // a lease holds the gil, so the interpreters are kept out of the pool by sticking them instead of holding them
+    Result python(size_t count, uint64_t userId)
+    {
+        Result result;
+        for (size_t i = 0; i < count; i++)
+        {
+            StickyTicket ticket{userId, i, "vmstartup", std::chrono::hours(1)};
+
+            auto begin = steady_clock::now();
+            auto lease = PythonVMPool::acquire(nullptr, &ticket);
+            auto started = steady_clock::now();
+            Py_XDECREF(lease.run("crypto.gbkToUTF8, json.loads, requests.get, system.delay"));
+            PyErr_Clear();
+            auto used = steady_clock::now();
+
+            lease.stick();
+
+            result.startup += microseconds(started - begin) / count;
+            result.firstUse += microseconds(used - begin) / count;
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = 1 < argc ? std::strtoull(argv[1], nullptr, 10) : 100;
+    // sub-interpreters take far longer to create
+    size_t pythonCount = std::max<size_t>(1, count / 5);
+
+    // room for the interpreters of both modes
+    g_stickyMaxVMs = pythonCount * 2;
+    g_stickyMemoryLimit = SIZE_MAX;
+
+    PythonVMPool::initialize();
+
+    Result results[2][3];
+    for (auto lazy : {false, true})
+    {
+        g_lazyModuleBinding = lazy;
+
+        results[lazy][0] = lua(count);
+        results[lazy][1] = javascript(count);
+        results[lazy][2] = python(pythonCount, lazy ? 2 : 1);
+    }
+
+    const char *languages[] = {"lua", "javascript", "python"};
+
+    std::printf("%zu lua and javascript vms, %zu python interpreters per mode, microseconds per vm\n", count, pythonCount);
+    std::printf("%-12s %14s %14s %14s %14s\n", "language", "eager startup", "lazy startup", "eager 1st use", "lazy 1st use");
+    for (size_t i = 0; i < std::size(languages); i++)
+        std::printf(
+            "%-12s %14.1f %14.1f %14.1f %14.1f\n",
+            languages[i],
+            results[false][i].startup,
+            results[true][i].startup,
+            results[false][i].firstUse,
+            results[true][i].firstUse);
+
+    luaLeases.clear();
+    javascriptLeases.clear();
+
+    return 0;
+}
\ No newline at end of file
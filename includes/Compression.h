@@ -0,0 +1,54 @@
+#ifndef COMPRESSION_H // !COMPRESSION_H
+#define COMPRESSION_H
+
+#include <zlib.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/**
+ * @name Compression
+ * @brief the raw deflate streams of one connection, one per direction
+ *
+ * every frame is flushed with Z_SYNC_FLUSH but the streams are never reset, so a frame is compressed against the
+ * history of all frames before it and repetitive frames such as log lines shrink to a few bytes. frames must therefore
+ * be decompressed in the order they were compressed.
+ */
+class Compression
+{
+public:
+    // gets the compressed frame while the stream is still held, so frames are sent in the order they were compressed
+    using send_t = std::function<int(std::string_view compressed)>;
+
+public:
+    Compression(int level = Z_DEFAULT_COMPRESSION);
+    Compression(const Compression &) = delete;
+    ~Compression();
+
+    /**
+     * @name compress
+     * @brief compress a frame and pass it to `send`, may be called from any thread
+     *
+     * @return result of `send`, -1 if compressing failed
+     */
+    int compress(std::string_view input, const send_t &send);
+
+    /**
+     * @name decompress
+     * @brief decompress a frame into `output`, calls must be serialized in the order the frames arrived
+     *
+     * fails if the frame is corrupt or inflates to more than `limit` bytes, the stream is unusable afterwards
+     */
+    bool decompress(std::string_view input, std::string &output, size_t limit);
+
+private:
+    std::mutex m_deflateMutex;
+    z_stream m_deflate{};
+    std::string m_deflated;
+
+    z_stream m_inflate{};
+};
+
+#endif // !COMPRESSION_H
\ No newline at end of file
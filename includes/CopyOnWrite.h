@@ -0,0 +1,77 @@
+#ifndef COPY_ON_WRITE_H // !COPY_ON_WRITE_H
+#define COPY_ON_WRITE_H
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+/**
+ * @name CopyOnWrite
+ * @brief a value read through immutable snapshots, writers publish a modified copy
+ *
+ * a snapshot stays valid and unchanged for as long as it is held. readers share a lock for the copy of one pointer
+ * only and never wait for the copy a writer makes, writers are serialized. suits data read far more often than written.
+ */
+template <typename value_t>
+class CopyOnWrite
+{
+public:
+    using snapshot_t = std::shared_ptr<const value_t>;
+
+public:
+    CopyOnWrite()
+        : m_value(std::make_shared<const value_t>())
+    {
+    }
+    CopyOnWrite(const CopyOnWrite &) = delete;
+
+    snapshot_t load() const
+    {
+        std::shared_lock<std::shared_mutex> locker(m_valueMutex);
+
+        return m_value;
+    }
+
+    /**
+     * @name update
+     * @brief call `update` with a copy of the current value, then publish the copy
+     */
+    template <typename update_t>
+    void update(update_t &&update)
+    {
+        std::unique_lock<std::mutex> locker(m_writeMutex);
+
+        auto copy = std::make_shared<value_t>(*m_value);
+        update(*copy);
+        publish(std::move(copy));
+    }
+
+    /**
+     * @name take
+     * @brief publish an empty value and return the previous one
+     */
+    snapshot_t take()
+    {
+        std::unique_lock<std::mutex> locker(m_writeMutex);
+
+        return publish(std::make_shared<const value_t>());
+    }
+
+private:
+    // caller must hold m_writeMutex, returns the previous value
+    snapshot_t publish(snapshot_t &&value)
+    {
+        std::unique_lock<std::shared_mutex> locker(m_valueMutex);
+
+        m_value.swap(value);
+
+        return std::move(value);
+    }
+
+private:
+    std::mutex m_writeMutex;
+    mutable std::shared_mutex m_valueMutex;
+    snapshot_t m_value;
+};
+
+#endif // !COPY_ON_WRITE_H
\ No newline at end of file
@@ -0,0 +1,120 @@
+#ifndef EVENT_LOOP_H // !EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <curl/include/curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @name EventLoop
+ * @brief one thread serving timers on a hashed wheel and curl transfers on a shared multi handle
+ *
+ * callbacks run on the loop thread and must not block, they usually hand the work back to the thread pool.
+ * the thread is started on first use.
+ */
+class EventLoop
+{
+public:
+    using callback_t = std::function<void()>;
+    using transfer_callback_t = std::function<void(CURLcode result)>;
+
+public:
+    EventLoop(std::chrono::milliseconds tick = std::chrono::milliseconds(1), size_t slots = 4096);
+    EventLoop(const EventLoop &) = delete;
+    ~EventLoop();
+
+    /**
+     * @name at
+     * @brief run `callback` once `time` has passed
+     *
+     * @return id of the timer for cancel(...), never 0
+     */
+    uint64_t at(std::chrono::steady_clock::time_point time, callback_t &&callback);
+
+    uint64_t after(std::chrono::milliseconds delay, callback_t &&callback);
+
+    /**
+     * @name cancel
+     * @brief drop a timer, returns false if it already fired or was cancelled
+     */
+    bool cancel(uint64_t timer);
+
+    /**
+     * @name perform
+     * @brief run the transfer of an easy handle, `callback` gets its result once it is done or aborted
+     *
+     * the handle stays owned by the caller and must be kept alive until the callback ran
+     *
+     * @return id of the transfer for abort(...), never 0
+     */
+    uint64_t perform(CURL *curl, transfer_callback_t &&callback);
+
+    /**
+     * @name abort
+     * @brief stop a transfer, its callback gets CURLE_ABORTED_BY_CALLBACK. finished transfers are ignored
+     */
+    void abort(uint64_t transfer);
+
+    size_t timers();
+
+    size_t transfers();
+
+private:
+    struct Timer
+    {
+        uint64_t id;
+        uint64_t tick;
+        callback_t callback;
+    };
+
+    struct Transfer
+    {
+        CURL *curl;
+        transfer_callback_t callback;
+    };
+
+    void start();
+
+    void run();
+
+    // caller must hold m_mutex, returns the callbacks of the timers due at `now`
+    std::vector<callback_t> expire(std::chrono::steady_clock::time_point now);
+
+    // caller must hold m_mutex
+    std::chrono::milliseconds idle(std::chrono::steady_clock::time_point now);
+
+    // loop thread only
+    void finish(uint64_t transfer, CURLcode result);
+
+private:
+    const std::chrono::steady_clock::time_point m_origin;
+    const std::chrono::milliseconds m_tick;
+
+    std::mutex m_mutex;
+    std::vector<std::list<Timer>> m_wheel;
+    std::unordered_map<uint64_t, std::list<Timer>::iterator> m_timers;
+    // last tick whose timers were fired
+    uint64_t m_current = 0;
+    uint64_t m_nextId = 1;
+    // transfers are added and aborted on the loop thread, other threads queue these
+    std::vector<callback_t> m_commands;
+
+    // loop thread only
+    std::unordered_map<uint64_t, Transfer> m_transfers;
+    std::unordered_map<CURL *, uint64_t> m_handles;
+    std::atomic<size_t> m_transferCount = 0;
+
+    CURLM *m_multi = nullptr;
+    std::once_flag m_started;
+    std::atomic<bool> m_stopped = false;
+    std::thread m_thread;
+};
+
+#endif // !EVENT_LOOP_H
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef JAVASCRIPT_VM_POOL_H // !JAVASCRIPT_VM_POOL_H
+#define JAVASCRIPT_VM_POOL_H
+
+#include "VMAllocator.h"
+
+#include <quickjs-cmake/quickjs/quickjs.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @name JavascriptVMPool
+ * @brief per-worker pool of long-lived quickjs runtimes
+ *
+ * every lease gets a fresh context with all modules bound on a runtime kept by this thread.
+ * when a lease ends the context is freed and the runtime is garbage collected for the next task.
+ */
+class JavascriptVMPool
+{
+private:
+    struct VM
+    {
+        std::unique_ptr<VMAllocator> allocator;
+        JSRuntime *runtime = nullptr;
+        // heap in use by a runtime without contexts
+        size_t baseline = 0;
+
+        ~VM();
+    };
+
+public:
+    class Lease
+    {
+    public:
+        Lease(std::unique_ptr<VM> &&vm, JSContext *context)
+            : m_vm(std::move(vm)),
+              m_context(context)
+        {
+        }
+        Lease(const Lease &) = delete;
+        Lease(Lease &&other) = default;
+
+        ~Lease()
+        {
+            if (nullptr != m_vm)
+                release(std::move(m_vm), m_context, m_discard);
+        }
+
+        // nullptr if the runtime could not be created
+        JSRuntime *runtime() const
+        {
+            return nullptr == m_vm ? nullptr : m_vm->runtime;
+        }
+
+        // nullptr if the context could not be created
+        JSContext *context() const
+        {
+            return m_context;
+        }
+
+        VMAllocator &allocator() const
+        {
+            return *m_vm->allocator;
+        }
+
+        // free the runtime instead of returning it, e.g. after its heap was exhausted
+        void discard()
+        {
+            m_discard = true;
+        }
+
+    private:
+        std::unique_ptr<VM> m_vm;
+        JSContext *m_context;
+        bool m_discard = false;
+    };
+
+public:
+    /**
+     * @name acquire
+     * @brief take the idle runtime of this thread or create one, then create a context bound to `loggerOptions`
+     */
+    static Lease acquire(void *loggerOptions);
+
+    /**
+     * @name eval
+     * @brief evaluate `script` in the global scope through the bytecode cache, same results as `JS_Eval`
+     */
+    static JSValue eval(JSContext *context, const std::string &script);
+
+private:
+    // idle runtimes kept per thread
+    static constexpr size_t maxIdle = 1;
+    // heap a collected runtime may keep above its baseline before it is freed
+    static constexpr size_t maxRetainedGrowth = 4 * 1024 * 1024;
+
+    static std::vector<std::unique_ptr<VM>> &idle();
+
+    static std::unique_ptr<VM> create();
+
+    static JSContext *newContext(JSRuntime *runtime, void *loggerOptions);
+
+    // getter and setter of a module which is not bound yet, `magic` indexes the module
+    static JSValue lazyAccessor(JSContext *context, JSValueConst thisValue, int argc, JSValueConst *argv, int magic, JSValue *data);
+
+    static void release(std::unique_ptr<VM> &&vm, JSContext *context, bool discard);
+};
+
+#endif // !JAVASCRIPT_VM_POOL_H
\ No newline at end of file
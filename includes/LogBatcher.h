@@ -0,0 +1,85 @@
+#ifndef LOG_BATCHER_H // !LOG_BATCHER_H
+#define LOG_BATCHER_H
+
+#include "NetworkService.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @name LogBatcher
+ * @brief coalesces the log lines of tasks into one logBatch packet per client
+ *
+ * a packet goes out once its records reach `flushSize` bytes or `flushDelay` after its first record. the first line
+ * of a runner is preceded by a record announcing its task, later lines carry the runner id only. clients older than
+ * revision 3 get one log packet per line as before.
+ */
+class LogBatcher
+{
+public:
+    enum class Record : uint8_t
+    {
+        // runner id u64, request id u32, user id u64, task id u64, task name
+        task,
+        // runner id u64, log type u8, message
+        line,
+    };
+
+private:
+    struct Batch
+    {
+        std::mutex mutex;
+        // the packet being filled, empty while nothing is queued
+        std::optional<yasio::obstream> packet;
+        size_t packetSize = 0;
+        // runners whose task was announced to the client
+        std::unordered_set<uint64_t> runners;
+        uint64_t timer = 0;
+        // dropped from m_batches, appenders look it up again
+        bool closed = false;
+    };
+
+public:
+    LogBatcher(NetworkService &service, size_t flushSize, std::chrono::milliseconds flushDelay);
+    LogBatcher(const LogBatcher &) = delete;
+
+    void append(
+        uint32_t clientId,
+        uint32_t requestId,
+        uint64_t runnerId,
+        uint64_t userId,
+        uint64_t taskId,
+        std::string_view taskName,
+        uint8_t logType,
+        std::string_view message);
+
+    // send the queued records of a client now
+    void flush(uint32_t clientId);
+
+    /**
+     * @name finish
+     * @brief flush the records of a client and forget the runner, call it before the result packet of the runner
+     */
+    void finish(uint32_t clientId, uint64_t runnerId);
+
+private:
+    std::shared_ptr<Batch> find(uint32_t clientId, bool create);
+
+    // caller must hold the mutex of `batch`
+    void send(uint32_t clientId, Batch &batch);
+
+private:
+    NetworkService &m_service;
+    const size_t m_flushSize;
+    const std::chrono::milliseconds m_flushDelay;
+
+    std::mutex m_mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<Batch>> m_batches;
+};
+
+#endif // !LOG_BATCHER_H
\ No newline at end of file
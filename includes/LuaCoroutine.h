@@ -0,0 +1,97 @@
+#ifndef LUA_COROUTINE_H // !LUA_COROUTINE_H
+#define LUA_COROUTINE_H
+
+#include "TaskControl.h"
+#include "Scheduler.h"
+
+#include <luajit/src/lua.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+/**
+ * @name LuaCoroutine
+ * @brief runs a lua task as a coroutine, so that builtins which wait give the thread back instead of blocking it
+ *
+ * such a builtin calls suspend(...), the coroutine yields and the worker returns to the pool. once the wait is
+ * completed, usually by the event loop, the coroutine is resumed on any pool thread. a task started by the scheduler
+ * gives its slot back while it is suspended and is queued again with its user through Scheduler::resume(...).
+ */
+class LuaCoroutine : public std::enable_shared_from_this<LuaCoroutine>
+{
+public:
+    // pushes the results of the suspended builtin onto the coroutine, returns their count
+    using results_t = std::function<int(lua_State *luaState)>;
+    // completes a wait from any thread, only the first completion of a wait counts
+    using complete_t = std::function<void(results_t &&results)>;
+    // starts a wait, returns a function which cancels it
+    using wait_t = std::function<std::function<void()>(const complete_t &complete)>;
+    // the function returned or failed, its results or the error message are on the stack of `thread`
+    using finished_t = std::function<void(int status, lua_State *thread)>;
+
+public:
+    LuaCoroutine(lua_State *luaState, TaskControl *control, finished_t &&finished);
+    LuaCoroutine(const LuaCoroutine &) = delete;
+
+    /**
+     * @name start
+     * @brief pop a function and its `arguments` from the stack of `luaState` and run them as a coroutine
+     *
+     * `finished` is called exactly once, on the calling thread unless the coroutine suspends
+     */
+    static void start(lua_State *luaState, int arguments, TaskControl *control, finished_t &&finished);
+
+    /**
+     * @name suspendable
+     * @brief whether a builtin called with `luaState` may suspend, i.e. it runs directly in a coroutine task
+     *
+     * false across a c-call boundary as well, e.g. in a string.gsub callback, a table.sort comparator or a metamethod.
+     * the builtin blocks there as it would outside a coroutine
+     */
+    static bool suspendable(lua_State *luaState);
+
+    /**
+     * @name suspend
+     * @brief give the thread back until the wait is completed, use as `return LuaCoroutine::suspend(...)`
+     *
+     * an interrupt of the task or its wall-clock deadline complete the wait as well and fail the task
+     */
+    static int suspend(lua_State *luaState, wait_t &&wait);
+
+private:
+    // resume with `arguments` results on the stack of the coroutine, a negative count fails the task
+    void run(int arguments);
+
+    // called once the yield and the completion both happened, returns the argument count for run(...)
+    int take();
+
+    void complete(uint64_t wait, results_t &&results);
+
+private:
+    lua_State *m_state;
+    lua_State *m_thread;
+    // keeps the coroutine alive while it is suspended
+    int m_reference;
+    TaskControl *m_control;
+    finished_t m_finished;
+    // user and priority of the task in the scheduler, empty if it was not started by one
+    std::optional<Scheduler::Context> m_context;
+    // set by suspend(...), any other yield is not ours
+    bool m_suspended = false;
+
+    std::mutex m_mutex;
+    uint64_t m_wait = 0;
+    bool m_completed = false;
+    results_t m_results;
+    std::function<void()> m_cancel;
+    uint64_t m_deadlineTimer = 0;
+    // the yield and the completion of a wait, whichever comes last continues the coroutine
+    std::atomic<int> m_arrivals = 0;
+
+    inline static thread_local LuaCoroutine *t_current = nullptr;
+};
+
+#endif // !LUA_COROUTINE_H
\ No newline at end of file
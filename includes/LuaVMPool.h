@@ -0,0 +1,149 @@
+#ifndef LUA_VM_POOL_H // !LUA_VM_POOL_H
+#define LUA_VM_POOL_H
+
+#include "StickyCache.h"
+#include "VMAllocator.h"
+
+#include <luajit/src/lua.hpp>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @name LuaVMPool
+ * @brief per-worker pool of initialized lua vms
+ *
+ * a vm is created once with the standard libraries and all modules bound, then a snapshot of its globals is taken.
+ * when a lease ends the globals are scrubbed back to the snapshot and the vm is kept for the next task of this thread.
+ */
+class LuaVMPool
+{
+private:
+    struct VM
+    {
+        std::unique_ptr<VMAllocator> allocator;
+        lua_State *state = nullptr;
+        // registry reference of the globals snapshot
+        int snapshot = LUA_NOREF;
+        // heap in use by a pristine vm
+        size_t baseline = 0;
+
+        ~VM();
+    };
+
+public:
+    class Lease
+    {
+    public:
+        Lease(std::unique_ptr<VM> &&vm, const StickyTicket *ticket = nullptr, bool warm = false)
+            : m_vm(std::move(vm)),
+              m_warm(warm)
+        {
+            if (nullptr != ticket)
+                m_ticket = *ticket;
+        }
+        Lease(const Lease &) = delete;
+        Lease(Lease &&other) = default;
+
+        ~Lease()
+        {
+            if (nullptr != m_vm)
+                release(std::move(m_vm), m_discard, m_stick && m_ticket.has_value() ? &*m_ticket : nullptr);
+        }
+
+        // nullptr if the vm could not be created
+        lua_State *state() const
+        {
+            return nullptr == m_vm ? nullptr : m_vm->state;
+        }
+
+        VMAllocator &allocator() const
+        {
+            return *m_vm->allocator;
+        }
+
+        // close the vm instead of returning it, e.g. after its heap was exhausted
+        void discard()
+        {
+            m_discard = true;
+        }
+
+        // resumed from the sticky cache, the script of the task is loaded and its passport is set
+        bool warm() const
+        {
+            return m_warm;
+        }
+
+        // keep the vm as it is for the next run of the task, needs the lease to be acquired with a ticket
+        void stick()
+        {
+            m_stick = true;
+        }
+
+    private:
+        std::unique_ptr<VM> m_vm;
+        std::optional<StickyTicket> m_ticket;
+        bool m_warm;
+        bool m_discard = false;
+        bool m_stick = false;
+    };
+
+public:
+    /**
+     * @name acquire
+     * @brief take an idle vm of this thread or create one, the logger of the vm is bound to `loggerOptions`
+     *
+     * with a ticket the warm vm of the task is resumed if the sticky cache holds one
+     */
+    static Lease acquire(void *loggerOptions, const StickyTicket *ticket = nullptr);
+
+    /**
+     * @name invalidate
+     * @brief close the warm vm of a task, returns false if there is none
+     */
+    static bool invalidate(uint64_t userId, uint64_t taskId);
+
+    /**
+     * @name load
+     * @brief load `script` as a chunk through the bytecode cache, same results as `luaL_loadbuffer`
+     */
+    static int load(lua_State *luaState, const std::string &script);
+
+    /**
+     * @name pushRunner
+     * @brief push the function running a task, `runner(chunk, passport, methods...)`
+     *
+     * it runs the chunk and setTaskPassport unless the chunk is nil, then the methods in order. it returns the
+     * result of the last method, or nil, the name of the failed function and the reason
+     */
+    static void pushRunner(lua_State *luaState);
+
+private:
+    // idle vms kept per thread
+    static constexpr size_t maxIdle = 2;
+    // heap a scrubbed vm may keep above its baseline before it is closed
+    static constexpr size_t maxRetainedGrowth = 4 * 1024 * 1024;
+
+    static std::vector<std::unique_ptr<VM>> &idle();
+
+    static std::unique_ptr<VM> create();
+
+    static StickyCache<VM> &sticky();
+
+    static void release(std::unique_ptr<VM> &&vm, bool discard, const StickyTicket *ticket);
+
+    // returns a registry reference of the snapshot
+    static int snapshot(lua_State *luaState);
+
+    // copy of `table` into `contents` and its metatable into `metatables`, all of them stack indices
+    static void record(lua_State *luaState, int contents, int metatables, int table);
+
+    static void restore(lua_State *luaState, int snapshot);
+
+    // __index of the globals, binds a module on its first access
+    static int lazyIndex(lua_State *luaState);
+};
+
+#endif // !LUA_VM_POOL_H
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef METRICS_H // !METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace Metrics
+{
+    using counter_t = std::atomic<int64_t>;
+    using gauge_t = std::function<int64_t()>;
+
+    /**
+     * @name counter
+     * @brief get or create a named counter, the returned reference stays valid for the whole process
+     */
+    counter_t &counter(const std::string &name);
+
+    /**
+     * @name gauge
+     * @brief register a named gauge whose value is sampled on every snapshot
+     */
+    void gauge(const std::string &name, gauge_t &&gauge);
+
+    std::vector<std::pair<std::string, int64_t>> snapshot();
+}
+
+#endif // !METRICS_H
\ No newline at end of file
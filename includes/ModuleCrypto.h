@@ -1,6 +1,8 @@
 #ifndef MODULE_CRYPTO_H // !MODULE_CRYPTO_H
 #define MODULE_CRYPTO_H
 
+#include "common.h"
+
 #include <luajit/src/lua.hpp>
 #include <luabridge/Source/LuaBridge/LuaBridge.h>
 #include <Python.h>
@@ -2,6 +2,9 @@
 #define MODULE_REQUESTS_H
 
 #include "common.h"
+#include "global.h"
+#include "LuaCoroutine.h"
+#include "TaskControl.h"
 
 #include <luajit/src/lua.hpp>
 #include <luabridge/Source/LuaBridge/LuaBridge.h>
@@ -9,6 +12,7 @@
 #include <pybind11/include/pybind11/pybind11.h>
 #include <quickjs-cmake/quickjs/quickjs.h>
 #include <quickjsbind.h>
+#include <ThreadPool.h>
 #include <curl/include/curl/curl.h>
 
 #include <string>
@@ -31,15 +35,44 @@ namespace ModuleRequests
             std::string content;
         };
 
+        // a request performed by the event loop while its lua task is suspended
+        struct Transfer
+        {
+            CURL *curl = curl_easy_init();
+            curl_slist *headers = nullptr;
+            // curl does not copy the body
+            std::string data;
+            RequestResult result;
+
+            ~Transfer()
+            {
+                curl_slist_free_all(headers);
+                curl_easy_cleanup(curl);
+            }
+        };
+
+        CURLcode perform(CURL *curl);
+
+        // set the options of a request, returns the header list to free once it is done
+        curl_slist *setup(CURL *curl, const std::string &url, const std::string &data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout, RequestResult &result);
+
+        // fill in the status of a finished request
+        void complete(CURL *curl, CURLcode status, RequestResult &result);
+
         RequestResult request(CURL *curl, const std::string &url, const std::string &data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout);
+
+        void luaPushResult(lua_State *luaState, const RequestResult &result);
+
+        // performs the request through the event loop if the task can suspend, blocks otherwise
+        int luaRequest(lua_State *luaState, const char *method, const std::string &url, std::string &&data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout);
     }
 
     namespace Bindings
     {
-        luabridge::LuaRef luaGet(lua_State *luaState);
-        luabridge::LuaRef luaPost(lua_State *luaState);
-        luabridge::LuaRef luaPut(lua_State *luaState);
-        luabridge::LuaRef luaDelete(lua_State *luaState);
+        int luaGet(lua_State *luaState);
+        int luaPost(lua_State *luaState);
+        int luaPut(lua_State *luaState);
+        int luaDelete(lua_State *luaState);
 
         pybind11::dict pyGet(pybind11::args args);
         pybind11::dict pyPost(pybind11::args args);
@@ -7,7 +7,13 @@
 #include <pybind11/include/pybind11/pybind11.h>
 #include <quickjs-cmake/quickjs/quickjs.h>
 #include <quickjsbind.h>
+#include <ThreadPool.h>
 
+#include "global.h"
+#include "LuaCoroutine.h"
+#include "TaskControl.h"
+
+#include <algorithm>
 #include <thread>
 
 namespace ModuleSystem
@@ -19,6 +25,9 @@ namespace ModuleSystem
     void bind(JSContext *context);
 
     void delay(size_t milliseconds);
+
+    // system.delay of lua, suspends a coroutine task instead of blocking its thread
+    int luaDelay(lua_State *luaState);
 }
 
 #endif // !MODULE_SYSTEM_H
\ No newline at end of file
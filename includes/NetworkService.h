@@ -2,15 +2,21 @@
 #define NETWORK_SERVICE_H
 
 #include "global.h"
+#include "CopyOnWrite.h"
+#include "Compression.h"
 
 #include <yasio/yasio/yasio.hpp>
 #include <yasio/yasio/ibstream.hpp>
 #include <yasio/yasio/obstream.hpp>
 
-#include <mutex>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 class NetworkService
 {
@@ -23,6 +29,14 @@ private:
         status,
         log,
         result,
+        metrics,
+        invalidate,
+        // N run descriptors, or N runner ids for status and stop, in one frame with one reply
+        runBatch,
+        statusBatch,
+        stopBatch,
+        // log lines of several tasks, see LogBatcher
+        logBatch,
         __max,
     };
 
@@ -30,63 +44,122 @@ private:
     {
         bool handshaked;
         yasio::transport_handle_t transportHandle;
+        // protocol revision agreed on in the handshake
+        uint8_t revision;
+        uint8_t capabilities;
+        // streams of the connection if it agreed on compression
+        std::shared_ptr<Compression> compression;
     };
 
 public:
     using client_t = ClientInfo;
     using command_t = Command;
 
-    using event_callback_t = std::function<void(uint32_t clientId, yasio::ibstream_view &)>;
+    // revision 1 is the original protocol. from revision 2 on every frame after the handshake carries a u32 request id
+    // behind its command, replies echo the id of their request and the log and result packets of a task the id of its run.
+    // from revision 3 on the log lines of tasks arrive in logBatch packets
+    static constexpr uint8_t protocolRevision = 3;
+
+    // a capability byte may follow the revision in the handshake, the reply echoes the capabilities both sides support.
+    // with compression packets of `g_compressionThreshold` bytes or more set compressedFlag in their command and deflate
+    // their body behind the request id, each direction on one stream for the whole connection
+    enum class Capability : uint8_t
+    {
+        compression = 1 << 0,
+    };
+
+    static constexpr uint8_t capabilities = static_cast<uint8_t>(Capability::compression);
+    static constexpr uint8_t compressedFlag = 0x80;
+
+    // `requestId` is 0 for clients of revision 1
+    using event_callback_t = std::function<void(uint32_t clientId, uint32_t requestId, yasio::ibstream_view &)>;
     using event_handler_t = event_callback_t;
+    using redirect_t = std::function<int(yasio::packet_t &&packet)>;
 
 public:
     NetworkService(const char *host, uint16_t port);
     ~NetworkService();
 
-    int backward(uint32_t clientId, yasio::packet_t &&packet);
+    /**
+     * @name backward
+     * @brief send a packet to a client, `requestId` is added to it if the client speaks revision 2 or later
+     */
+    int backward(uint32_t clientId, yasio::packet_t &&packet, uint32_t requestId = 0);
 
-    auto addEventCallback(command_t command, event_callback_t &&callback)
-    {
-        std::unique_lock<std::mutex> locker(m_mutex);
+    // protocol revision of a handshaked client, 0 for unknown clients and in worker processes
+    uint8_t revision(uint32_t clientId);
 
-        return m_eventCallbacks.emplace(command, std::move(callback));
+    /**
+     * @name redirect
+     * @brief hand the packets of backward(...) to `redirect` instead of the clients, e.g. in a worker process
+     */
+    void redirect(redirect_t &&redirect)
+    {
+        m_redirect = std::move(redirect);
     }
 
-    template <typename iterator_t>
-    void removeEventCallback(iterator_t callbackIt)
+    /**
+     * @name addEventCallback
+     * @brief run `callback` once, for the next packet of `command`
+     *
+     * @return id of the callback for removeEventCallback(...)
+     */
+    uint64_t addEventCallback(command_t command, event_callback_t &&callback)
     {
-        std::unique_lock<std::mutex> locker(m_mutex);
-
-        m_eventCallbacks.erase(callbackIt);
+        return addListener(m_eventCallbacks, command, std::move(callback));
     }
 
-    auto addEventHandler(command_t command, event_handler_t &&handler)
+    void removeEventCallback(command_t command, uint64_t callbackId)
     {
-        std::unique_lock<std::mutex> locker(m_mutex);
-
-        return m_eventHandlers.emplace(command, std::move(handler));
+        removeListener(m_eventCallbacks, command, callbackId);
     }
 
-    template <typename iterator_t>
-    void removeEventHandler(iterator_t handlerIt)
+    /**
+     * @name addEventHandler
+     * @brief run `handler` for every packet of `command`
+     *
+     * @return id of the handler for removeEventHandler(...)
+     */
+    uint64_t addEventHandler(command_t command, event_handler_t &&handler)
     {
-        std::unique_lock<std::mutex> locker(m_mutex);
+        return addListener(m_eventHandlers, command, std::move(handler));
+    }
 
-        m_eventHandlers.erase(handlerIt);
+    void removeEventHandler(command_t command, uint64_t handlerId)
+    {
+        removeListener(m_eventHandlers, command, handlerId);
     }
 
 private:
+    struct Listener
+    {
+        uint64_t id;
+        event_callback_t callback;
+    };
+
+    // the listeners of each command, dispatch iterates a snapshot while others add or remove them
+    using listeners_t = std::array<CopyOnWrite<std::vector<Listener>>, static_cast<size_t>(command_t::__max)>;
+
+    uint64_t addListener(listeners_t &listeners, command_t command, event_callback_t &&callback);
+
+    void removeListener(listeners_t &listeners, command_t command, uint64_t listenerId);
+
     bool isNormalPacket(const yasio::event_ptr &ev);
 
+    // inflate a compressed packet in place, returns false if the packet is corrupt. io thread only, in arrival order
+    bool inflatePacket(uint32_t transportId, yasio::packet_t &packet);
+
     void dataHandler(uint32_t transportId, yasio::transport_handle_t transportHandle, yasio::packet_t &packet);
 
 private:
-    std::mutex m_mutex;
     yasio::io_service m_service;
 
-    std::unordered_map<uint32_t, client_t> m_clientInfos;
-    std::unordered_multimap<command_t, event_callback_t> m_eventCallbacks;
-    std::unordered_multimap<command_t, event_handler_t> m_eventHandlers;
+    // handshaked clients by transport id, written on handshake and close only
+    CopyOnWrite<std::unordered_map<uint32_t, client_t>> m_clientInfos;
+    listeners_t m_eventCallbacks;
+    listeners_t m_eventHandlers;
+    std::atomic<uint64_t> m_nextListenerId = 1;
+    redirect_t m_redirect;
 };
 
 #endif // !NETWORK_SERVICE_H
\ No newline at end of file
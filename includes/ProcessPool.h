@@ -0,0 +1,172 @@
+#ifndef PROCESS_POOL_H // !PROCESS_POOL_H
+#define PROCESS_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @name ProcessPool
+ * @brief worker processes forked from a zygote, linux only
+ *
+ * start(...) forks the zygote, which prepares the engines once and then forks every worker from its initialized
+ * memory, so the workers share it copy-on-write. a worker serves one request at a time, the request and the replies
+ * are frames on a socket pair. a killed worker is replaced by a fresh fork of the zygote when its lease ends.
+ */
+class ProcessPool
+{
+public:
+    // runs in the zygote once, before the first worker is forked
+    using prepare_t = std::function<void()>;
+    // runs in a worker for each request, replies are sent with reply(...)
+    using serve_t = std::function<void(std::string &&request)>;
+
+private:
+    struct Worker
+    {
+        int pid = -1;
+        int channel = -1;
+    };
+
+public:
+    enum class Receive : uint8_t
+    {
+        frame,
+        timeout,
+        closed,
+    };
+
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(ProcessPool *pool, Worker worker)
+            : m_pool(pool),
+              m_worker(worker)
+        {
+        }
+        Lease(const Lease &) = delete;
+        Lease(Lease &&other) noexcept
+            : m_pool(other.m_pool),
+              m_worker(other.m_worker),
+              m_broken(other.m_broken),
+              m_killed(other.m_killed.load())
+        {
+            other.m_pool = nullptr;
+        }
+
+        Lease &operator=(Lease &&other) noexcept
+        {
+            std::swap(m_pool, other.m_pool);
+            std::swap(m_worker, other.m_worker);
+            std::swap(m_broken, other.m_broken);
+            m_killed = other.m_killed.exchange(m_killed.load());
+
+            return *this;
+        }
+
+        ~Lease()
+        {
+            if (nullptr != m_pool)
+                m_pool->release(m_worker, m_broken || m_killed);
+        }
+
+        // false if no worker is left, e.g. the zygote died
+        bool valid() const
+        {
+            return nullptr != m_pool;
+        }
+
+        bool send(std::string_view frame);
+
+        /**
+         * @name receive
+         * @brief wait up to `timeout` for the next frame of the worker
+         *
+         * a closed channel means the worker exited or was killed, it is replaced when the lease ends
+         */
+        Receive receive(std::string &frame, std::chrono::milliseconds timeout);
+
+        /**
+         * @name kill
+         * @brief SIGKILL the worker, may be called from any thread while the lease is held
+         */
+        void kill();
+
+    private:
+        ProcessPool *m_pool = nullptr;
+        Worker m_worker;
+        bool m_broken = false;
+        // set by kill(...) from another thread, a killed worker is replaced even if its last reply came through
+        std::atomic<bool> m_killed = false;
+    };
+
+public:
+    ProcessPool() = default;
+    ProcessPool(const ProcessPool &) = delete;
+    ~ProcessPool();
+
+    /**
+     * @name start
+     * @brief fork the zygote and `workers` workers, returns false if forking is not supported or failed
+     *
+     * must be called before the first acquire(...). the zygote and the workers never return from here
+     */
+    bool start(size_t workers, prepare_t &&prepare, serve_t &&serve);
+
+    bool started() const
+    {
+        return -1 != m_zygote;
+    }
+
+    /**
+     * @name acquire
+     * @brief lease an idle worker, blocks until one is idle
+     */
+    Lease acquire();
+
+    /**
+     * @name reply
+     * @brief send a frame to the core from the request being served, worker processes only
+     */
+    static bool reply(std::string_view frame);
+
+    size_t size();
+
+    size_t idle();
+
+private:
+    // a broken worker is killed and replaced
+    void release(Worker worker, bool broken);
+
+    // ask the zygote for a new worker, caller must hold m_zygoteMutex
+    Worker spawn();
+
+    [[noreturn]] static void zygote(int channel, const prepare_t &prepare, const serve_t &serve);
+
+    [[noreturn]] static void worker(int channel, const serve_t &serve);
+
+    static bool write(int channel, std::string_view frame);
+
+    static bool read(int channel, std::string &frame);
+
+private:
+    int m_zygote = -1;
+    std::mutex m_zygoteMutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<Worker> m_idle;
+    // idle and leased workers
+    size_t m_size = 0;
+
+    // channel of this process to the core, worker processes only
+    inline static int s_channel = -1;
+};
+
+#endif // !PROCESS_POOL_H
\ No newline at end of file
@@ -0,0 +1,156 @@
+#ifndef PYTHON_VM_POOL_H // !PYTHON_VM_POOL_H
+#define PYTHON_VM_POOL_H
+
+#include <Python.h>
+#include <pybind11/include/pybind11/pybind11.h>
+
+#include "StickyCache.h"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// a per-interpreter gil needs python 3.12+ and a pybind11 which keeps its internals per interpreter
+#if !defined(PYTHON_OWN_GIL) && PY_VERSION_HEX >= 0x030C0000 && defined(PYBIND11_HAS_SUBINTERPRETER_SUPPORT)
+#define PYTHON_OWN_GIL
+#endif
+
+/**
+ * @name PythonVMPool
+ * @brief pool of initialized python sub-interpreters shared by all workers
+ *
+ * cpython is initialized once by initialize(). a sub-interpreter is created with all modules bound and a snapshot
+ * of its `__main__` dict and module dicts is taken. a lease attaches a fresh thread state of the calling thread to an
+ * idle interpreter, when it ends the dicts are reset to the snapshot and the interpreter is kept for the next task.
+ * interpreters are never ended, the pool grows to the peak number of concurrent python tasks.
+ *
+ * the interpreters share one allocator, so the heap a sticky task adds is estimated from the gc tracked objects of its
+ * interpreter and the untracked objects they refer to, before and after each run.
+ */
+class PythonVMPool
+{
+private:
+    struct VM
+    {
+        PyInterpreterState *interpreter = nullptr;
+        // never deleted, an interpreter whose thread list runs empty cannot hand out its first thread state again before 3.12
+        PyThreadState *keeper = nullptr;
+        PyObject *mainModule = nullptr;
+        // list of (dict, pristine copy)
+        PyObject *snapshot = nullptr;
+        // code objects compiled in this interpreter, cache key -> code
+        PyObject *codes = nullptr;
+        // estimated bytes a sticky task added to the interpreter over its runs, its size in the sticky cache
+        size_t stickySize = 0;
+        // estimated heap of the interpreter when the current lease of a sticky task began
+        size_t leaseHeapSize = 0;
+        // estimated heap of the interpreter after a reset, measured the first time a sticky task leases it
+        size_t pristineHeapSize = 0;
+    };
+
+public:
+    class Lease
+    {
+    public:
+        Lease(std::unique_ptr<VM> &&vm, PyThreadState *threadState, const StickyTicket *ticket = nullptr, bool warm = false)
+            : m_vm(std::move(vm)),
+              m_threadState(threadState),
+              m_warm(warm)
+        {
+            if (nullptr != ticket)
+                m_ticket = *ticket;
+        }
+        Lease(const Lease &) = delete;
+        Lease(Lease &&other) = default;
+
+        ~Lease()
+        {
+            if (nullptr != m_vm)
+                release(std::move(m_vm), m_threadState, m_stick && m_ticket.has_value() ? &*m_ticket : nullptr);
+        }
+
+        // nullptr if the interpreter could not be created
+        PyObject *mainModule() const
+        {
+            return nullptr == m_vm ? nullptr : m_vm->mainModule;
+        }
+
+        /**
+         * @name run
+         * @brief run `script` in `__main__` through the code cache, same results as `PyRun_String`
+         */
+        PyObject *run(const std::string &script) const
+        {
+            return PythonVMPool::run(*m_vm, script);
+        }
+
+        // resumed from the sticky cache, the script of the task is loaded and its passport is set
+        bool warm() const
+        {
+            return m_warm;
+        }
+
+        // keep the interpreter as it is for the next run of the task, needs the lease to be acquired with a ticket
+        void stick()
+        {
+            m_stick = true;
+        }
+
+    private:
+        std::unique_ptr<VM> m_vm;
+        PyThreadState *m_threadState;
+        std::optional<StickyTicket> m_ticket;
+        bool m_warm;
+        bool m_stick = false;
+    };
+
+public:
+    /**
+     * @name initialize
+     * @brief initialize cpython, must be called once on the main thread before the first lease
+     */
+    static void initialize();
+
+    /**
+     * @name acquire
+     * @brief attach the calling thread to an idle interpreter or a new one, holds its gil until the lease ends
+     *
+     * with a ticket the warm interpreter of the task is resumed if the sticky cache holds one
+     */
+    static Lease acquire(void *loggerOptions, const StickyTicket *ticket = nullptr);
+
+    /**
+     * @name invalidate
+     * @brief reset the warm interpreter of a task and return it to the pool, returns false if there is none
+     */
+    static bool invalidate(uint64_t userId, uint64_t taskId);
+
+private:
+    // code objects kept per interpreter
+    static constexpr Py_ssize_t maxCodes = 256;
+
+    struct Idle
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<VM>> vms;
+    };
+
+    static Idle &idle();
+
+    static std::unique_ptr<VM> create(PyThreadState *&threadState);
+
+    static PyObject *snapshot(PyObject *mainModule);
+
+    static PyObject *run(VM &vm, const std::string &script);
+
+    // module level __getattr__ of a module which is not bound yet
+    static pybind11::object lazyAttribute(const char *name, void (*bind)(PyObject *mainModule), const std::string &attribute);
+
+    static StickyCache<VM> &sticky();
+
+    static void release(std::unique_ptr<VM> &&vm, PyThreadState *threadState, const StickyTicket *ticket);
+};
+
+#endif // !PYTHON_VM_POOL_H
\ No newline at end of file
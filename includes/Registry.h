@@ -0,0 +1,179 @@
+#ifndef REGISTRY_H // !REGISTRY_H
+#define REGISTRY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @name Registry
+ * @brief sharded table of live objects addressed by generation-counted 64-bit ids
+ *
+ * an id is the generation of its slot in the high bits and the slot index in the low bits. a slot's generation
+ * is bumped every time it is reused, so an id of a finished object never reaches the object holding its slot later.
+ * lookups lock a single shard only and never hash, inserts and erases from any thread are O(1) as well.
+ */
+template <typename value_t>
+class Registry
+{
+public:
+    using handle_t = std::shared_ptr<value_t>;
+
+public:
+    Registry()
+    {
+        for (auto &shard : m_shards)
+            shard = std::make_unique<Shard>();
+    }
+    Registry(const Registry &) = delete;
+
+    /**
+     * @name insert
+     * @brief register `value`, the returned id is never 0
+     */
+    uint64_t insert(handle_t value)
+    {
+        // spread consecutive inserts over the shards
+        auto shardIndex = m_nextShard.fetch_add(1, std::memory_order_relaxed) % shardCount;
+        auto &shard = *m_shards[shardIndex];
+        m_size.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t id;
+        {
+            std::unique_lock<std::mutex> locker(shard.mutex);
+
+            uint32_t index;
+            if (!shard.free.empty())
+            {
+                index = shard.free.back();
+                shard.free.pop_back();
+            }
+            else
+            {
+                index = static_cast<uint32_t>(shard.slots.size());
+                shard.slots.emplace_back();
+            }
+
+            auto &slot = shard.slots[index];
+            // generation 0 is skipped, so no id is 0
+            slot.generation = (slot.generation + 1) & generationMask;
+            if (0 == slot.generation)
+                slot.generation = 1;
+            slot.value = std::move(value);
+
+            id = slot.generation << indexBits | (static_cast<uint64_t>(index) * shardCount + shardIndex);
+        }
+
+        return id;
+    }
+
+    /**
+     * @name find
+     * @brief get the object of `id`, nullptr if it was erased or the id is stale
+     */
+    handle_t find(uint64_t id)
+    {
+        auto [shard, index, generation] = locate(id);
+        std::unique_lock<std::mutex> locker(shard.mutex);
+
+        if (index >= shard.slots.size() || generation != shard.slots[index].generation)
+            return nullptr;
+
+        return shard.slots[index].value;
+    }
+
+    /**
+     * @name erase
+     * @brief unregister the object of `id`, wakes up wait() when the registry becomes empty
+     *
+     * @return false if the id is stale
+     */
+    bool erase(uint64_t id)
+    {
+        // the object is released outside of the shard lock
+        handle_t value;
+        {
+            auto [shard, index, generation] = locate(id);
+            std::unique_lock<std::mutex> locker(shard.mutex);
+
+            if (index >= shard.slots.size() || generation != shard.slots[index].generation || nullptr == shard.slots[index].value)
+                return false;
+
+            value = std::move(shard.slots[index].value);
+            shard.free.push_back(index);
+        }
+
+        if (1 == m_size.fetch_sub(1, std::memory_order_acq_rel))
+        {
+            {
+                std::unique_lock<std::mutex> locker(m_emptyMutex);
+            }
+            m_empty.notify_all();
+        }
+
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_size.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @name wait
+     * @brief block until every registered object was erased
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> locker(m_emptyMutex);
+
+        m_empty.wait(locker, [this]
+                     { return 0 == size(); });
+    }
+
+private:
+    static constexpr size_t shardCount = 16;
+    // 16M live objects per registry, 2^40 reuses of a slot before an id repeats
+    static constexpr uint64_t indexBits = 24;
+    static constexpr uint64_t generationMask = (uint64_t(1) << (64 - indexBits)) - 1;
+
+    struct Slot
+    {
+        uint64_t generation = 0;
+        handle_t value;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free;
+    };
+
+    struct Location
+    {
+        Shard &shard;
+        size_t index;
+        uint64_t generation;
+    };
+
+    Location locate(uint64_t id)
+    {
+        auto slot = id & ((uint64_t(1) << indexBits) - 1);
+
+        return {*m_shards[slot % shardCount], static_cast<size_t>(slot / shardCount), id >> indexBits};
+    }
+
+private:
+    std::unique_ptr<Shard> m_shards[shardCount];
+    std::atomic<size_t> m_nextShard = 0;
+    std::atomic<size_t> m_size = 0;
+
+    std::mutex m_emptyMutex;
+    std::condition_variable m_empty;
+};
+
+#endif // !REGISTRY_H
\ No newline at end of file
@@ -0,0 +1,126 @@
+#ifndef SCHEDULER_H // !SCHEDULER_H
+#define SCHEDULER_H
+
+#include "ThreadPool.h"
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * @name Scheduler
+ * @brief per-user fair-share queue in front of the thread pool
+ *
+ * jobs are queued per user, served across users with deficit round-robin (weighted by the user's weight)
+ * and by priority inside one user. at most `userConcurrency` jobs of one user are in flight at once. a job is in
+ * flight while it runs on a thread only, a suspended job gives its slot back and its continuation is queued again.
+ */
+class Scheduler
+{
+private:
+    struct Job
+    {
+        int32_t priority;
+        uint64_t sequence;
+        ThreadPool::Task task;
+    };
+
+    struct User
+    {
+        std::vector<Job> jobs; // binary heap, highest priority first
+        int64_t deficit = 0;
+        size_t inflight = 0;
+        bool active = false;
+    };
+
+public:
+    // the user and priority of a job, its continuations are queued with them
+    struct Context
+    {
+        Scheduler *scheduler;
+        uint64_t userId;
+        int32_t priority;
+    };
+
+    struct Submission
+    {
+        uint64_t userId;
+        int32_t priority;
+        ThreadPool::Task task;
+    };
+
+private:
+    // a dispatched job. the pool runs a task holding a pointer to it, a job wrapped in a task would not fit inline
+    struct Running
+    {
+        Context context;
+        ThreadPool::Task task;
+        // next free node
+        Running *next = nullptr;
+    };
+
+public:
+    Scheduler(ThreadPool &threadPool, size_t maxInflight, size_t userConcurrency, uint32_t quantum = 4);
+    Scheduler(const Scheduler &) = delete;
+    ~Scheduler();
+
+    void submit(uint64_t userId, int32_t priority, ThreadPool::Task &&task);
+
+    // queue several jobs under one lock and dispatch them at once, e.g. the runs of a batch frame
+    void submit(std::vector<Submission> &&submissions);
+
+    // context of the job running on this thread, empty outside a job of a scheduler
+    static std::optional<Context> current();
+
+    /**
+     * @name resume
+     * @brief queue a continuation of a suspended job behind the other jobs of its user, it takes a slot like a new job
+     */
+    static void resume(const Context &context, ThreadPool::Task &&task);
+
+    void setWeight(uint64_t userId, uint32_t weight);
+
+    void setUserConcurrency(size_t userConcurrency);
+
+    size_t pending();
+
+    size_t inflight();
+
+private:
+    static bool jobLess(const Job &left, const Job &right);
+
+    // caller must hold m_mutex
+    void enqueue(uint64_t userId, int32_t priority, ThreadPool::Task &&task);
+
+    static void run(Running *running);
+
+    void complete(Running *running);
+
+    void dispatch(std::vector<ThreadPool::Task> &ready);
+
+    void launch(std::vector<ThreadPool::Task> &ready);
+
+private:
+    ThreadPool &m_threadPool;
+    size_t m_maxInflight;
+    size_t m_userConcurrency;
+    uint32_t m_quantum;
+
+    std::mutex m_mutex;
+    std::unordered_map<uint64_t, User> m_users;
+    std::unordered_map<uint64_t, uint32_t> m_weights;
+    std::deque<uint64_t> m_activeUsers;
+    uint64_t m_sequence = 0;
+    size_t m_pending = 0;
+    size_t m_inflight = 0;
+    // nodes of finished jobs, at most as many as were in flight at once
+    Running *m_freeRunning = nullptr;
+
+    // context of the job running on this thread
+    inline static thread_local const Context *t_context = nullptr;
+};
+
+#endif // !SCHEDULER_H
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef SCRIPT_CACHE_H // !SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include "Metrics.h"
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @name ScriptCache
+ * @brief lru cache of compiled scripts keyed by a hash of their source
+ *
+ * entries are opaque blobs produced by the engine, the memory used by them is bounded by `capacity`.
+ * if a directory is set entries are also written there, so they survive restarts of the process. entries on disk
+ * carry a checksum, a damaged one is deleted instead of loaded.
+ */
+class ScriptCache
+{
+public:
+    using blob_t = std::shared_ptr<const std::string>;
+
+public:
+    /**
+     * @param name prefix of the hit and miss counters
+     * @param capacity bytes of compiled scripts kept in memory
+     * @param salt mixed into every key, should change whenever the compiled format does (e.g. engine version)
+     * @param directory on-disk cache, empty to keep entries in memory only
+     */
+    ScriptCache(const std::string &name, size_t capacity, const std::string &salt, const std::filesystem::path &directory = {});
+
+    /**
+     * @name key
+     * @brief cache key of a script source
+     */
+    std::string key(const std::string &source) const;
+
+    /**
+     * @name find
+     * @brief get the compiled script of `key`, nullptr on miss
+     */
+    blob_t find(const std::string &key);
+
+    void insert(const std::string &key, std::string &&compiled);
+
+    // drop an entry the engine rejected, from memory and disk
+    void erase(const std::string &key);
+
+    void clear();
+
+    /**
+     * @name setDirectory
+     * @brief enable the on-disk cache, an empty path disables it
+     */
+    void setDirectory(const std::filesystem::path &directory);
+
+    size_t size();
+
+private:
+    struct Entry
+    {
+        std::string key;
+        blob_t blob;
+    };
+
+    blob_t load(const std::string &key);
+
+    void store(const std::string &key, const std::string &compiled);
+
+    // caller must hold m_mutex
+    void emplace(const std::string &key, blob_t &&blob);
+
+private:
+    std::mutex m_mutex;
+    std::list<Entry> m_entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+    size_t m_size = 0;
+    size_t m_capacity;
+    std::string m_salt;
+    std::filesystem::path m_directory;
+
+    Metrics::counter_t &m_hits;
+    Metrics::counter_t &m_misses;
+};
+
+#endif // !SCRIPT_CACHE_H
\ No newline at end of file
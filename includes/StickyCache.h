@@ -0,0 +1,223 @@
+#ifndef STICKY_CACHE_H // !STICKY_CACHE_H
+#define STICKY_CACHE_H
+
+#include "Metrics.h"
+
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @name StickyTicket
+ * @brief asks a vm pool to resume the warm vm of a task and to keep the vm for the next run afterwards
+ */
+struct StickyTicket
+{
+    uint64_t userId;
+    uint64_t taskId;
+    // hash of everything the warm state depends on, i.e. the script and the passport
+    std::string fingerprint;
+    std::chrono::milliseconds ttl;
+};
+
+/**
+ * @name StickyCache
+ * @brief warm vms kept per (userId, taskId) for a while after their task finished
+ *
+ * entries expire after their ttl, are dropped when the fingerprint of the next run differs and are evicted in lru
+ * order when the cache holds more than `maxSize` bytes or `maxCount` vms. dropped vms are handed to the disposer
+ * outside of the lock.
+ */
+template <typename value_t>
+class StickyCache
+{
+public:
+    using disposer_t = std::function<void(std::unique_ptr<value_t> &&)>;
+
+public:
+    StickyCache(const std::string &name, size_t maxSize, size_t maxCount, disposer_t &&disposer)
+        : m_maxSize(maxSize),
+          m_maxCount(maxCount),
+          m_disposer(std::move(disposer)),
+          m_hits(Metrics::counter(name + ".hits")),
+          m_misses(Metrics::counter(name + ".misses")),
+          m_evicted(Metrics::counter(name + ".evicted"))
+    {
+    }
+
+    /**
+     * @name take
+     * @brief remove and return the warm vm of the ticket's task, nullptr if there is none or it is stale
+     */
+    std::unique_ptr<value_t> take(const StickyTicket &ticket)
+    {
+        std::unique_ptr<value_t> result;
+        std::vector<std::unique_ptr<value_t>> dropped;
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+
+            expire(dropped);
+
+            if (auto it = m_index.find({ticket.userId, ticket.taskId}); m_index.end() != it)
+            {
+                if (ticket.fingerprint == it->second->fingerprint)
+                    result = std::move(it->second->value);
+                else
+                    dropped.push_back(std::move(it->second->value));
+                erase(it->second);
+            }
+        }
+        dispose(dropped);
+
+        if (nullptr == result)
+            m_misses++;
+        else
+            m_hits++;
+
+        return result;
+    }
+
+    /**
+     * @name put
+     * @brief keep `value` as the warm vm of the ticket's task, `size` is its heap in bytes
+     */
+    void put(const StickyTicket &ticket, std::unique_ptr<value_t> &&value, size_t size)
+    {
+        std::vector<std::unique_ptr<value_t>> dropped;
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+
+            expire(dropped);
+
+            if (auto it = m_index.find({ticket.userId, ticket.taskId}); m_index.end() != it)
+            {
+                dropped.push_back(std::move(it->second->value));
+                erase(it->second);
+            }
+
+            if (size > m_maxSize || 0 == m_maxCount)
+                dropped.push_back(std::move(value));
+            else
+            {
+                m_entries.push_front({
+                    {ticket.userId, ticket.taskId},
+                    ticket.fingerprint,
+                    std::chrono::steady_clock::now() + ticket.ttl,
+                    size,
+                    std::move(value),
+                });
+                m_index.emplace(m_entries.front().key, m_entries.begin());
+                m_size += size;
+
+                while (m_size > m_maxSize || m_entries.size() > m_maxCount)
+                {
+                    dropped.push_back(std::move(m_entries.back().value));
+                    erase(std::prev(m_entries.end()));
+                }
+            }
+        }
+        dispose(dropped);
+    }
+
+    /**
+     * @name invalidate
+     * @brief drop the warm vm of a task
+     *
+     * @return true if there was one
+     */
+    bool invalidate(uint64_t userId, uint64_t taskId)
+    {
+        std::vector<std::unique_ptr<value_t>> dropped;
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+
+            if (auto it = m_index.find({userId, taskId}); m_index.end() != it)
+            {
+                dropped.push_back(std::move(it->second->value));
+                erase(it->second);
+            }
+        }
+        dispose(dropped);
+
+        return !dropped.empty();
+    }
+
+private:
+    using key_t = std::pair<uint64_t, uint64_t>;
+
+    struct KeyHash
+    {
+        size_t operator()(const key_t &key) const
+        {
+            return std::hash<uint64_t>{}(key.first) ^ (std::hash<uint64_t>{}(key.second) * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    struct Entry
+    {
+        key_t key;
+        std::string fingerprint;
+        std::chrono::steady_clock::time_point expiry;
+        size_t size;
+        std::unique_ptr<value_t> value;
+    };
+
+    // caller must hold m_mutex
+    void erase(typename std::list<Entry>::iterator entry)
+    {
+        m_size -= entry->size;
+        m_index.erase(entry->key);
+        m_entries.erase(entry);
+    }
+
+    // caller must hold m_mutex
+    void expire(std::vector<std::unique_ptr<value_t>> &dropped)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto it = m_entries.begin(); m_entries.end() != it;)
+        {
+            if (it->expiry > now)
+            {
+                ++it;
+                continue;
+            }
+
+            dropped.push_back(std::move(it->value));
+            erase(it++);
+        }
+    }
+
+    void dispose(std::vector<std::unique_ptr<value_t>> &dropped)
+    {
+        for (auto &value : dropped)
+        {
+            if (nullptr == value)
+                continue;
+
+            m_evicted++;
+            m_disposer(std::move(value));
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::list<Entry> m_entries;
+    std::unordered_map<key_t, typename std::list<Entry>::iterator, KeyHash> m_index;
+    size_t m_size = 0;
+    size_t m_maxSize;
+    size_t m_maxCount;
+    disposer_t m_disposer;
+
+    Metrics::counter_t &m_hits;
+    Metrics::counter_t &m_misses;
+    Metrics::counter_t &m_evicted;
+};
+
+#endif // !STICKY_CACHE_H
\ No newline at end of file
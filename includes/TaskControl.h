@@ -0,0 +1,179 @@
+#ifndef TASK_CONTROL_H // !TASK_CONTROL_H
+#define TASK_CONTROL_H
+
+#include <luajit/src/lua.hpp>
+#include <Python.h>
+#include <quickjs-cmake/quickjs/quickjs.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+/**
+ * @name TaskControl
+ * @brief per-task interrupt state shared between the runner thread and controller threads
+ *
+ * the runner installs the engine hooks through bind(...), controllers call interrupt(...) from any thread.
+ * blocking builtins find the control of the running task through TaskControl::current().
+ */
+class TaskControl
+{
+public:
+    enum class Reason : uint8_t
+    {
+        none,
+        cancelled,
+        wallTimeout,
+        cpuTimeout,
+        memoryLimit,
+    };
+
+    class Scope
+    {
+    public:
+        Scope(TaskControl *control)
+            : m_previous(t_current)
+        {
+            t_current = control;
+        }
+        Scope(const Scope &) = delete;
+
+        ~Scope()
+        {
+            t_current = m_previous;
+        }
+
+    private:
+        TaskControl *m_previous;
+    };
+
+public:
+    ~TaskControl();
+
+    static TaskControl *current();
+
+    /**
+     * @name sleep
+     * @brief sleep on behalf of the current task, wakes up early when the task is interrupted
+     *
+     * @return false if the task was interrupted
+     */
+    static bool sleep(std::chrono::milliseconds duration);
+
+    bool interrupt(Reason reason);
+
+    Reason reason() const
+    {
+        return m_reason.load(std::memory_order_relaxed);
+    }
+
+    bool interrupted() const
+    {
+        return Reason::none != reason();
+    }
+
+    /**
+     * @name setBudget
+     * @brief limit the task's wall-clock and cpu time, zero means unlimited. must be called on the runner thread
+     */
+    void setBudget(std::chrono::milliseconds wallBudget, std::chrono::milliseconds cpuBudget);
+
+    /**
+     * @name poll
+     * @brief check the budgets and interrupt the task when one is exceeded, may be called from any thread
+     *
+     * @return true if the task is interrupted
+     */
+    bool poll();
+
+    // cpu time consumed by the runner thread since setBudget(...)
+    std::chrono::nanoseconds cpuTime() const;
+
+    std::chrono::steady_clock::time_point deadline() const
+    {
+        return m_deadline;
+    }
+
+    /**
+     * @name detach
+     * @brief the task leaves its thread, e.g. a suspended lua coroutine. cpu time is not counted until attach()
+     */
+    void detach();
+
+    /**
+     * @name attach
+     * @brief continue counting cpu time on the calling thread
+     */
+    void attach();
+
+    /**
+     * @name setCallback
+     * @brief run `callback` when the task is interrupted, right away if it already is. nullptr removes it
+     *
+     * the callback runs on the interrupting thread and must not block
+     */
+    void setCallback(std::function<void()> &&callback);
+
+    // compiled traces never call the hook, a hot loop is reached once it leaves its trace unless g_luaJit is off
+    void bind(lua_State *luaState);
+    void unbind(lua_State *luaState);
+
+    void bind(JSRuntime *runtime);
+    void unbind(JSRuntime *runtime);
+
+    /**
+     * @name bindPython
+     * @brief arm asynchronous exception delivery to the python code running on this thread, must hold the GIL
+     */
+    void bindPython();
+    void unbindPython();
+
+private:
+    // instructions between two interrupt checks of a lua task
+    static constexpr int luaHookCount = 1000;
+    // polls between two reads of the thread cpu clock
+    static constexpr uint32_t cpuPollInterval = 8;
+
+    static void luaHook(lua_State *luaState, lua_Debug *debug);
+
+    // measure cpu time on the calling thread
+    void bindCpuClock();
+
+    static int javascriptInterruptHandler(JSRuntime *runtime, void *opaque);
+
+    bool sleepFor(std::chrono::milliseconds duration);
+
+    // engines which cannot poll by themselves are polled by a shared watchdog thread
+    static void watch(TaskControl *control);
+    static void unwatch(TaskControl *control);
+
+private:
+    std::atomic<Reason> m_reason = Reason::none;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    std::mutex m_callbackMutex;
+    std::function<void()> m_callback;
+
+    std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::time_point::max();
+    std::chrono::nanoseconds m_cpuBudget = std::chrono::nanoseconds::zero();
+    std::chrono::nanoseconds m_cpuStart = std::chrono::nanoseconds::zero();
+    // clockid_t on posix, duplicated thread handle on windows
+    intptr_t m_cpuClock = 0;
+    // cpu time consumed up to detach()
+    std::chrono::nanoseconds m_cpuUsed = std::chrono::nanoseconds::zero();
+    bool m_detached = false;
+    std::atomic<uint32_t> m_polls = 0;
+    bool m_watched = false;
+
+    PyInterpreterState *m_pythonInterpreter = nullptr;
+    unsigned long m_pythonThreadId = 0;
+
+    inline static thread_local TaskControl *t_current = nullptr;
+};
+
+#endif // !TASK_CONTROL_H
\ No newline at end of file
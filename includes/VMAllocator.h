@@ -0,0 +1,100 @@
+#ifndef VM_ALLOCATOR_H // !VM_ALLOCATOR_H
+#define VM_ALLOCATOR_H
+
+#include "TaskControl.h"
+
+#include <luajit/src/lua.hpp>
+#include <quickjs-cmake/quickjs/quickjs.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @name VMAllocator
+ * @brief bounded heap of one script vm
+ *
+ * small blocks are served from per-thread size-class free lists, larger ones go to the system allocator.
+ * an allocation which would exceed the limit fails and interrupts the bound task with Reason::memoryLimit.
+ * one allocator serves one vm, which runs on one thread at a time, so the accounting is not synchronized.
+ */
+class VMAllocator
+{
+public:
+    // zero means unlimited
+    VMAllocator(size_t limit, TaskControl *control = nullptr);
+    VMAllocator(const VMAllocator &) = delete;
+
+    /**
+     * @name newLuaState
+     * @brief create a lua vm on this allocator, falls back to luaL_newstate() on builds without custom allocator support
+     */
+    lua_State *newLuaState();
+
+    /**
+     * @name arm
+     * @brief hand a pooled vm to the next task, resets the limit, the peak and the exhausted state
+     */
+    void arm(size_t limit, TaskControl *control);
+
+    JSRuntime *newJavascriptRuntime();
+
+    size_t used() const
+    {
+        return m_used;
+    }
+
+    size_t peak() const
+    {
+        return m_peak;
+    }
+
+    size_t limit() const
+    {
+        return m_limit;
+    }
+
+    // whether an allocation was refused
+    bool exhausted() const
+    {
+        return m_exhausted;
+    }
+
+private:
+    // blocks up to maxPooledSize bytes are pooled in classes of classGranularity bytes
+    static constexpr size_t classGranularity = 16;
+    static constexpr size_t maxPooledSize = 256;
+    static constexpr size_t classCount = maxPooledSize / classGranularity;
+    // free blocks cached per class and thread
+    static constexpr uint32_t maxPooledBlocks = 1024;
+    // keeps the javascript payload aligned behind the size header
+    static constexpr size_t headerSize = alignof(std::max_align_t);
+
+    struct Pool;
+
+    static Pool &pool();
+
+    static size_t sizeClass(size_t size);
+
+    static void *luaAlloc(void *userData, void *pointer, size_t oldSize, size_t newSize);
+
+    static void *javascriptMalloc(JSMallocState *state, size_t size);
+    static void javascriptFree(JSMallocState *state, void *pointer);
+    static void *javascriptRealloc(JSMallocState *state, void *pointer, size_t size);
+    static size_t javascriptMallocUsableSize(const void *pointer);
+
+    bool reserve(size_t oldSize, size_t newSize);
+
+    void *allocate(size_t size);
+    void deallocate(void *pointer, size_t size);
+    void *reallocate(void *pointer, size_t oldSize, size_t newSize);
+
+private:
+    size_t m_limit;
+    TaskControl *m_control;
+
+    size_t m_used = 0;
+    size_t m_peak = 0;
+    bool m_exhausted = false;
+};
+
+#endif // !VM_ALLOCATOR_H
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <string>
 #include <sstream>
 #include <unordered_map>
+#include <utility>
 
 namespace common
 {
@@ -19,6 +20,15 @@ namespace common
     std::string pythonDictToJson(const pybind11::dict &dict);
     std::string pythonListToJson(const pybind11::list &list);
 
+    // call a blocking native function without the gil, arguments are converted before and the result after the call
+    template <typename Function, typename... Args>
+    auto pythonWithoutGil(Function &&function, Args &&...args)
+    {
+        pybind11::gil_scoped_release release;
+
+        return std::forward<Function>(function)(std::forward<Args>(args)...);
+    }
+
     std::unordered_map<std::string, std::string> quickjsObjectToMap(const quickjs::value<JSValue> &object);
     std::string quickjsObjectToJson(const quickjs::value<JSValue> &object);
 }
@@ -2,11 +2,41 @@
 #define GLOBAL_H
 
 #include "ThreadPool.h"
+#include "Scheduler.h"
+#include "ScriptCache.h"
+#include "EventLoop.h"
+#include "ProcessPool.h"
 
+extern ThreadPool::Mode g_threadPoolMode;
 extern ThreadPool g_threadPool;
+extern Scheduler g_scheduler;
+extern EventLoop g_eventLoop;
+extern ProcessPool g_processPool;
 
 extern const char *g_serviceAddress;
 extern uint16_t g_servicePort;
 extern const char *g_serviceKey;
 
+extern size_t g_compressionThreshold;
+
+extern std::chrono::milliseconds g_defaultWallBudget;
+extern std::chrono::milliseconds g_defaultCpuBudget;
+extern size_t g_defaultMemoryLimit;
+
+extern bool g_lazyModuleBinding;
+
+extern bool g_luaJit;
+extern bool g_luaCoroutines;
+
+extern size_t g_preforkWorkers;
+
+extern size_t g_stickyMemoryLimit;
+extern size_t g_stickyMaxVMs;
+
+extern const char *g_scriptCacheDirectory;
+extern ScriptCache g_luaScriptCache;
+extern ScriptCache g_javascriptScriptCache;
+extern bool g_javascriptStripDebug;
+extern ScriptCache g_pythonScriptCache;
+
 #endif // !GLOBAL_H
\ No newline at end of file
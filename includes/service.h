@@ -13,6 +13,15 @@
 #include "ModuleTools.h"
 #include "ModuleSystem.h"
 #include "NetworkService.h"
+#include "TaskControl.h"
+#include "VMAllocator.h"
+#include "LuaVMPool.h"
+#include "LuaCoroutine.h"
+#include "JavascriptVMPool.h"
+#include "PythonVMPool.h"
+#include "Registry.h"
+#include "ProcessPool.h"
+#include "LogBatcher.h"
 
 #include <yasio/yasio/obstream.hpp>
 #include <luajit/src/lua.hpp>
@@ -25,10 +34,15 @@
 #include <string>
 #include <string_view>
 #include <sstream>
-#include <future>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
+#include <vector>
 
 extern NetworkService g_service;
+extern LogBatcher g_logBatcher;
 
 namespace Service
 {
@@ -49,13 +63,53 @@ namespace Service
             none,
         };
 
+        enum class InvalidateResult : uint8_t
+        {
+            // the task had no warm vm
+            none,
+            dropped,
+            // the warm vms are kept by the worker processes of the prefork mode, which the core cannot reach
+            rejected,
+        };
+
+        struct RunOptions
+        {
+            int32_t priority = 0;
+            // zero falls back to the server-wide default
+            std::chrono::milliseconds wallBudget = std::chrono::milliseconds::zero();
+            std::chrono::milliseconds cpuBudget = std::chrono::milliseconds::zero();
+            // heap limit of lua and javascript vms in bytes
+            size_t memoryLimit = 0;
+            // keep the vm of a lua or python task warm for this long after it completed, zero disables
+            std::chrono::milliseconds stickyTtl = std::chrono::milliseconds::zero();
+        };
+
+        // one run of a batch frame
+        struct RunDescriptor
+        {
+            uint64_t userId;
+            uint64_t taskId;
+            LanguageType language;
+            std::string name;
+            std::string script;
+            std::string passport;
+            std::string callMethods;
+            RunOptions options;
+        };
+
         struct TaskRunInfo
         {
             uint32_t clientId;
+            // request id of the run command, echoed in the log and result packets of the task
+            uint32_t requestId;
             uint64_t userId;
             uint64_t taskId;
-            TaskRunStatus status;
+            // written by the runner, read by status(...) from any thread
+            std::atomic<TaskRunStatus> status;
             std::string taskName;
+            // assigned when the run is registered
+            uint64_t runnerId = 0;
+            TaskControl control;
         };
 
         bool lua(
@@ -66,7 +120,9 @@ namespace Service
             const std::string &script,
             const std::string &passport,
             const std::string &callMethods,
-            std::promise<uint64_t> *runnerId);
+            const RunOptions &options,
+            uint64_t runnerId,
+            const std::shared_ptr<TaskRunInfo> &runInfo);
 
         bool python(
             uint32_t clientId,
@@ -76,7 +132,9 @@ namespace Service
             const std::string &script,
             const std::string &passport,
             const std::string &callMethods,
-            std::promise<uint64_t> *runnerId);
+            const RunOptions &options,
+            uint64_t runnerId,
+            const std::shared_ptr<TaskRunInfo> &runInfo);
 
         bool javascript(
             uint32_t clientId,
@@ -86,7 +144,44 @@ namespace Service
             const std::string &script,
             const std::string &passport,
             const std::string &callMethods,
-            std::promise<uint64_t> *runnerId);
+            const RunOptions &options,
+            uint64_t runnerId,
+            const std::shared_ptr<TaskRunInfo> &runInfo);
+
+        /**
+         * @name process
+         * @brief run a task in a worker process of g_processPool, the core relays its log and result packets
+         *
+         * stopping the task or exceeding its wall budget kills the worker, which is replaced by a fresh fork. core only
+         */
+        bool process(
+            LanguageType language,
+            uint32_t clientId,
+            uint64_t userId,
+            uint64_t taskId,
+            const std::string &name,
+            const std::string &script,
+            const std::string &passport,
+            const std::string &callMethods,
+            const RunOptions &options,
+            uint64_t runnerId,
+            const std::shared_ptr<TaskRunInfo> &runInfo);
+
+        // runs a task sent by process(...), worker processes only
+        void serve(std::string &&request);
+
+        /**
+         * @name admit
+         * @brief register a run and build its scheduler job, the run reports as waiting from now on. core only
+         *
+         * @return runner id of the task, 0 if its language is unknown
+         */
+        uint64_t admit(uint32_t clientId, uint32_t requestId, RunDescriptor &&descriptor, Scheduler::Submission &submission);
+
+        // returns the runner id of the task
+        uint64_t registerRunInfo(std::shared_ptr<TaskRunInfo> runInfo);
+
+        void unregisterRunInfo(uint64_t runnerId);
 
         std::vector<std::string> stringSplitAscii(const std::string_view &str, const std::string_view &delimiter);
 
@@ -96,8 +191,11 @@ namespace Service
     using language_t = Detail::LanguageType;
     using task_run_status_t = Detail::TaskRunStatus;
     using task_run_info_t = Detail::TaskRunInfo;
+    using run_options_t = Detail::RunOptions;
+    using run_descriptor_t = Detail::RunDescriptor;
+    using invalidate_result_t = Detail::InvalidateResult;
 
-    extern std::unordered_map<uint64_t, Detail::TaskRunInfo *> taskRunInfo;
+    extern Registry<Detail::TaskRunInfo> taskRunInfo;
 
     uint64_t run(
         uint32_t clientId,
@@ -107,12 +205,28 @@ namespace Service
         const std::string &name,
         const std::string &script,
         const std::string &passport,
-        const std::string &callMethods);
+        const std::string &callMethods,
+        const run_options_t &options = {},
+        uint32_t requestId = 0);
+
+    /**
+     * @name run
+     * @brief register all the runs of a batch and hand them to the scheduler at once. core only
+     *
+     * @return runner id of each descriptor in order, 0 if its language is unknown
+     */
+    std::vector<uint64_t> run(uint32_t clientId, std::vector<run_descriptor_t> &&descriptors, uint32_t requestId = 0);
 
     bool stop(uint64_t runnerId);
 
     task_run_status_t status(uint64_t runnerId);
 
+    // run the tasks in `workers` worker processes from now on, returns false if the prefork mode is not available. core only
+    bool prefork(size_t workers);
+
+    // drop the warm vms of a sticky task, rejected while the tasks run in worker processes
+    invalidate_result_t invalidate(uint64_t userId, uint64_t taskId);
+
     void join();
 }
 
@@ -9,47 +9,213 @@
 #include <condition_variable>
 #include <deque>
 #include <future>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include <cstddef>
 #include <type_traits>
 
 class ThreadPool
 {
 public:
-    ThreadPool(size_t threadPoolSize = std::thread::hardware_concurrency() + 3)
+    enum class Mode : uint8_t
     {
-        for (uint32_t i = 0; i < threadPoolSize; i++)
+        shared,   // 所有工作线程共享一个全局队列
+        stealing, // 每个工作线程拥有独立队列，空闲时从其他线程窃取任务
+    };
+
+    /**
+     * @name Task
+     * @brief 仅可移动的执行体，小对象直接存放在内联缓冲区中，避免堆分配
+     */
+    class Task
+    {
+    public:
+        Task() noexcept = default;
+
+        template <typename runable_t, typename = std::enable_if_t<!std::is_same_v<std::decay_t<runable_t>, Task>>>
+        Task(runable_t &&runable)
         {
-            m_workers.emplace_back(
-                [this]
-                {
-                    while (m_started)
-                    {
-                        std::function<void()> task(nullptr);
+            using stored_t = std::decay_t<runable_t>;
 
-                        if (!m_tasks.empty())
-                            m_takeCondition.notify_one();
-                        {
-                            std::unique_lock<std::mutex> locker(m_takeMutex);
-                            m_takeCondition.wait(locker, [this]
-                                                 { return !m_tasks.empty(); });
-                            task = std::move(m_tasks.front());
-                            m_tasks.pop_front();
-                        }
+            if constexpr (sizeof(stored_t) <= sizeof(m_storage) && alignof(stored_t) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<stored_t>)
+            {
+                new (m_storage) stored_t(std::forward<runable_t>(runable));
+                m_operations = &inlineOperations<stored_t>;
+            }
+            else
+            {
+                new (m_storage) stored_t *(new stored_t(std::forward<runable_t>(runable)));
+                m_operations = &heapOperations<stored_t>;
+            }
+        }
+        Task(const Task &) = delete;
+        Task(Task &&other) noexcept
+        {
+            moveFrom(other);
+        }
 
-                        if (nullptr != task)
-                            task();
-                    }
-                });
+        ~Task()
+        {
+            reset();
         }
+
+        Task &operator=(const Task &) = delete;
+        Task &operator=(Task &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                moveFrom(other);
+            }
+
+            return *this;
+        }
+
+        void operator()()
+        {
+            m_operations->invoke(m_storage);
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return nullptr != m_operations;
+        }
+
+    private:
+        struct Operations
+        {
+            void (*invoke)(void *storage);
+            void (*move)(void *destination, void *source) noexcept;
+            void (*destroy)(void *storage) noexcept;
+        };
+
+        template <typename stored_t>
+        static constexpr Operations inlineOperations{
+            [](void *storage)
+            { (*std::launder(reinterpret_cast<stored_t *>(storage)))(); },
+            [](void *destination, void *source) noexcept
+            {
+                auto runable = std::launder(reinterpret_cast<stored_t *>(source));
+                new (destination) stored_t(std::move(*runable));
+                runable->~stored_t();
+            },
+            [](void *storage) noexcept
+            { std::launder(reinterpret_cast<stored_t *>(storage))->~stored_t(); },
+        };
+
+        template <typename stored_t>
+        static constexpr Operations heapOperations{
+            [](void *storage)
+            { (**std::launder(reinterpret_cast<stored_t **>(storage)))(); },
+            [](void *destination, void *source) noexcept
+            { new (destination) stored_t *(*std::launder(reinterpret_cast<stored_t **>(source))); },
+            [](void *storage) noexcept
+            { delete *std::launder(reinterpret_cast<stored_t **>(storage)); },
+        };
+
+        void moveFrom(Task &other) noexcept
+        {
+            if (nullptr == other.m_operations)
+                return;
+
+            other.m_operations->move(m_storage, other.m_storage);
+            m_operations = other.m_operations;
+            other.m_operations = nullptr;
+        }
+
+        void reset() noexcept
+        {
+            if (nullptr == m_operations)
+                return;
+
+            m_operations->destroy(m_storage);
+            m_operations = nullptr;
+        }
+
+    private:
+        alignas(std::max_align_t) unsigned char m_storage[48];
+        const Operations *m_operations = nullptr;
+    };
+
+public:
+    struct Statistics
+    {
+        size_t size;     // 当前工作线程数量
+        size_t idle;     // 空闲等待任务的工作线程数量
+        size_t blocked;  // 阻塞在已知阻塞调用中的工作线程数量
+        size_t pending;  // 等待执行的任务数量
+        uint64_t spawned; // 累计创建的工作线程数量
+        uint64_t retired; // 累计因空闲超时退出的工作线程数量
+    };
+
+    /**
+     * @name BlockingScope
+     * @brief 标记当前工作线程进入阻塞调用，线程池在必要时创建补偿线程，非线程池线程上无效果
+     */
+    class BlockingScope
+    {
+    public:
+        BlockingScope()
+            : m_pool(t_owner)
+        {
+            if (nullptr != m_pool)
+                m_pool->enterBlocking();
+        }
+        BlockingScope(const BlockingScope &) = delete;
+
+        ~BlockingScope()
+        {
+            if (nullptr != m_pool)
+                m_pool->m_blocked.fetch_sub(1);
+        }
+
+    private:
+        ThreadPool *m_pool;
+    };
+
+public:
+    ThreadPool(size_t threadPoolSize = std::thread::hardware_concurrency() + 3, Mode mode = Mode::shared)
+        : ThreadPool(threadPoolSize, threadPoolSize, mode)
+    {
+    }
+    /**
+     * @param minSize 常驻工作线程数量
+     * @param maxSize 工作线程数量上限，工作线程阻塞时按需创建补偿线程
+     * @param mode 调度模式
+     * @param idleTimeout 超出常驻数量的工作线程空闲超过该时长后退出
+     */
+    ThreadPool(size_t minSize, size_t maxSize, Mode mode, std::chrono::milliseconds idleTimeout = std::chrono::seconds(60))
+        : m_mode(mode),
+          m_minSize(std::max<size_t>(1, minSize)),
+          m_maxSize(std::max(m_minSize, maxSize)),
+          m_idleTimeout(idleTimeout)
+    {
+        m_workers.reserve(m_maxSize);
+        for (size_t i = 0; i < m_maxSize; i++)
+            m_workers.emplace_back(std::make_unique<Worker>());
+
+        for (size_t i = 0; i < m_minSize; i++)
+            spawn();
     }
     ~ThreadPool()
     {
-        m_started = false;
-        for (size_t i = m_tasks.size(); i < m_workers.size(); i++)
-            m_tasks.emplace_back([] {});
+        {
+            std::unique_lock<std::mutex> locker(m_resizeMutex);
+
+            m_started = false;
+        }
+        {
+            std::unique_lock<std::mutex> locker(m_takeMutex);
+        }
         m_takeCondition.notify_all();
-        for (auto &v : m_workers)
-            if (v.joinable())
-                v.join();
+        for (auto &worker : m_workers)
+            unpark(*worker);
+
+        for (auto &worker : m_workers)
+            if (worker->thread.joinable())
+                worker->thread.join();
     }
 
     /**
@@ -77,21 +243,36 @@ public:
         using result_t = typename std::result_of<runable_t &(param_t...)>::type;
 #endif
 #endif //!_MSC_VER
-        auto task = std::make_shared<std::packaged_task<result_t()>>(
-            std::bind(runable, std::forward<param_t>(params)...));
+        std::packaged_task<result_t()> task(
+            [runable, ... params = std::forward<param_t>(params)]() mutable -> result_t
+            { return std::invoke(runable, params...); });
 
-        auto result = task->get_future();
-        {
-            std::unique_lock<std::mutex> locker(m_takeMutex);
-
-            m_tasks.emplace_back([task]
-                                 { (*task)(); });
-        }
-        m_takeCondition.notify_one();
+        auto result = task.get_future();
+        push(std::move(task));
 
         return result;
     }
 
+    /**
+     * @name submit
+     * @brief 添加执行体到线程池中，不创建std::future，支持仅可移动的执行体
+     *
+     * @param runable 需要执行的函数或方法
+     * @param params 需要传递给执行函数或方法的参数
+     *
+     * @return void
+     */
+    template <typename runable_t, typename... param_t>
+    void submit(runable_t &&runable, param_t &&...params)
+    {
+        if constexpr (0 == sizeof...(param_t))
+            push(std::forward<runable_t>(runable));
+        else
+            push(
+                [runable = std::forward<runable_t>(runable), ... params = std::forward<param_t>(params)]() mutable
+                { std::invoke(runable, params...); });
+    }
+
     /**
      * @name addRunableNoWrap
      * @brief 添加无参无返回值执行体到线程池中，不进行包装
@@ -101,22 +282,307 @@ public:
      * @return void
      */
     template <typename runable_t>
-    void addRunableNoWrap(const runable_t &runable)
+    void addRunableNoWrap(runable_t &&runable)
+    {
+        push(std::forward<runable_t>(runable));
+    }
+
+    Mode mode() const
+    {
+        return m_mode;
+    }
+
+    size_t size() const
+    {
+        return m_size.load();
+    }
+
+    size_t minSize() const
+    {
+        return m_minSize;
+    }
+
+    size_t maxSize() const
+    {
+        return m_maxSize;
+    }
+
+    Statistics statistics() const
     {
+        return {
+            m_size.load(),
+            m_sleepers.load(),
+            m_blocked.load(),
+            m_pending.load(),
+            m_spawned.load(),
+            m_retired.load(),
+        };
+    }
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        std::atomic<bool> alive = false;
+
+        std::mutex mutex;
+        std::deque<Task> tasks;
+
+        std::mutex parkMutex;
+        std::condition_variable parkCondition;
+        std::atomic<bool> parked = false;
+    };
+
+    void push(Task &&task)
+    {
+        m_pending.fetch_add(1);
+
+        if (Mode::shared == m_mode)
+        {
+            {
+                std::unique_lock<std::mutex> locker(m_takeMutex);
+
+                m_tasks.emplace_back(std::move(task));
+            }
+            m_takeCondition.notify_one();
+        }
+        else
+        {
+            // 工作线程内提交的任务压入本地队列尾部(LIFO)，外部提交的任务轮询分发给存活的工作线程
+            auto index = t_index;
+            if (this != t_owner)
+            {
+                index = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+                for (size_t i = 0; i < m_workers.size() && !m_workers[index]->alive; i++)
+                    index = (index + 1) % m_workers.size();
+            }
+            {
+                auto &worker = *m_workers[index];
+                std::unique_lock<std::mutex> locker(worker.mutex);
+
+                worker.tasks.emplace_back(std::move(task));
+            }
+
+            // 唤醒一个休眠的工作线程，优先唤醒目标队列的所有者
+            if (0 < m_sleepers.load())
+            {
+                for (size_t i = 0; i < m_workers.size(); i++)
+                    if (unpark(*m_workers[(index + i) % m_workers.size()]))
+                        break;
+            }
+        }
+
+        // 没有空闲线程且有线程阻塞时补偿一个工作线程
+        if (0 == m_sleepers.load() && 0 < m_blocked.load())
+            spawn(true);
+    }
+
+    bool unpark(Worker &worker)
+    {
+        bool parked = true;
+        if (!worker.parked.compare_exchange_strong(parked, false))
+            return false;
+
+        {
+            std::unique_lock<std::mutex> locker(worker.parkMutex);
+        }
+        worker.parkCondition.notify_one();
+
+        return true;
+    }
+
+    void enterBlocking()
+    {
+        m_blocked.fetch_add(1);
+
+        if (0 < m_pending.load() && 0 == m_sleepers.load())
+            spawn(true);
+    }
+
+    /**
+     * @param compensation 补偿阻塞线程时只补足到未阻塞线程数量等于常驻数量，不为每次提交都创建线程
+     */
+    void spawn(bool compensation = false)
+    {
+        std::unique_lock<std::mutex> locker(m_resizeMutex);
+
+        if (!m_started || m_size.load() >= m_maxSize)
+            return;
+        if (compensation && m_size.load() >= m_minSize + m_blocked.load())
+            return;
+
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            auto &worker = *m_workers[i];
+            if (worker.alive)
+                continue;
+
+            // 回收已退出线程的句柄后复用该槽位
+            if (worker.thread.joinable())
+                worker.thread.join();
+
+            worker.alive = true;
+            m_size.fetch_add(1);
+            m_spawned.fetch_add(1);
+            worker.thread = std::thread(&ThreadPool::workerLoop, this, i);
+
+            return;
+        }
+    }
+
+    bool retire(size_t index)
+    {
+        auto &worker = *m_workers[index];
+        std::unique_lock<std::mutex> locker(m_resizeMutex);
+
+        if (!m_started || m_size.load() <= m_minSize)
+            return false;
+        if (Mode::stealing == m_mode)
+        {
+            std::unique_lock<std::mutex> queueLocker(worker.mutex);
+
+            if (!worker.tasks.empty())
+                return false;
+        }
+
+        worker.alive = false;
+        m_size.fetch_sub(1);
+        m_retired.fetch_add(1);
+
+        return true;
+    }
+
+    bool take(size_t index, Task &task, bool &timeout)
+    {
+        if (Mode::shared == m_mode)
         {
             std::unique_lock<std::mutex> locker(m_takeMutex);
 
-            m_tasks.emplace_back(std::move(runable));
+            m_sleepers.fetch_add(1);
+            timeout = !m_takeCondition.wait_for(locker, m_idleTimeout, [this]
+                                                { return !m_tasks.empty() || !m_started; });
+            m_sleepers.fetch_sub(1);
+            if (m_tasks.empty())
+                return false;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+
+            return true;
+        }
+
+        if (popLocal(index, task) || steal(index, task))
+            return true;
+
+        // 先标记休眠再复查待执行数量，与push中的先计数后唤醒配对，避免丢失唤醒
+        auto &self = *m_workers[index];
+        self.parked = true;
+        m_sleepers.fetch_add(1);
+        if (0 == m_pending.load() && m_started)
+        {
+            std::unique_lock<std::mutex> locker(self.parkMutex);
+
+            timeout = !self.parkCondition.wait_for(locker, m_idleTimeout, [&self]
+                                                   { return !self.parked; });
+        }
+        self.parked = false;
+        m_sleepers.fetch_sub(1);
+
+        return false;
+    }
+
+    bool popLocal(size_t index, Task &task)
+    {
+        auto &worker = *m_workers[index];
+        std::unique_lock<std::mutex> locker(worker.mutex);
+
+        if (worker.tasks.empty())
+            return false;
+
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+
+        return true;
+    }
+
+    bool steal(size_t index, Task &task)
+    {
+        // xorshift随机选择起始受害者，避免所有窃取者集中在同一个队列
+        t_random ^= t_random << 13;
+        t_random ^= t_random >> 7;
+        t_random ^= t_random << 17;
+
+        auto start = t_random % m_workers.size();
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            auto victim = (start + i) % m_workers.size();
+            if (victim == index)
+                continue;
+
+            auto &worker = *m_workers[victim];
+            std::unique_lock<std::mutex> locker(worker.mutex, std::try_to_lock);
+            if (!locker.owns_lock() || worker.tasks.empty())
+                continue;
+
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void workerLoop(size_t index)
+    {
+        t_owner = this;
+        t_index = index;
+        t_random = 0x9E3779B97F4A7C15ull ^ (index + 1);
+
+        while (m_started)
+        {
+            Task task;
+            bool timeout = false;
+
+            if (take(index, task, timeout))
+            {
+                m_pending.fetch_sub(1);
+                task();
+                continue;
+            }
+
+            if (timeout && retire(index))
+                break;
         }
-        m_takeCondition.notify_one();
+
+        t_owner = nullptr;
     }
 
 private:
-    std::vector<std::thread> m_workers;
-    std::deque<std::function<void()>> m_tasks;
-    bool m_started = true;
+    Mode m_mode;
+    size_t m_minSize;
+    size_t m_maxSize;
+    std::chrono::milliseconds m_idleTimeout;
+    std::atomic<bool> m_started = true;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::mutex m_resizeMutex;
+
+    std::deque<Task> m_tasks;
     std::mutex m_takeMutex;
     std::condition_variable m_takeCondition;
+
+    std::atomic<size_t> m_nextQueue = 0;
+    std::atomic<size_t> m_pending = 0;
+    std::atomic<size_t> m_sleepers = 0;
+    std::atomic<size_t> m_size = 0;
+    std::atomic<size_t> m_blocked = 0;
+    std::atomic<uint64_t> m_spawned = 0;
+    std::atomic<uint64_t> m_retired = 0;
+
+    inline static thread_local ThreadPool *t_owner = nullptr;
+    inline static thread_local size_t t_index = 0;
+    inline static thread_local uint64_t t_random = 0;
 };
 
 #endif //! THREAD_POOL_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "Compression.h"
+
+#include <algorithm>
+
+using self = Compression;
+
+self::Compression(int level)
+{
+    // negative window bits select raw deflate, the frames carry no zlib header or checksum
+    deflateInit2(&m_deflate, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    inflateInit2(&m_inflate, -MAX_WBITS);
+}
+
+self::~Compression()
+{
+    deflateEnd(&m_deflate);
+    inflateEnd(&m_inflate);
+}
+
+int self::compress(std::string_view input, const send_t &send)
+{
+    std::unique_lock<std::mutex> locker(m_deflateMutex);
+
+    m_deflated.clear();
+    m_deflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    m_deflate.avail_in = static_cast<uInt>(input.size());
+
+    do
+    {
+        auto offset = m_deflated.size();
+        m_deflated.resize(offset + std::max<size_t>(deflateBound(&m_deflate, m_deflate.avail_in), 64));
+
+        m_deflate.next_out = reinterpret_cast<Bytef *>(m_deflated.data() + offset);
+        m_deflate.avail_out = static_cast<uInt>(m_deflated.size() - offset);
+
+        auto result = deflate(&m_deflate, Z_SYNC_FLUSH);
+        m_deflated.resize(m_deflated.size() - m_deflate.avail_out);
+
+        if (Z_OK != result && Z_BUF_ERROR != result)
+            return -1;
+    } while (0 == m_deflate.avail_out);
+
+    return send(m_deflated);
+}
+
+bool self::decompress(std::string_view input, std::string &output, size_t limit)
+{
+    m_inflate.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    m_inflate.avail_in = static_cast<uInt>(input.size());
+
+    do
+    {
+        auto offset = output.size();
+        output.resize(offset + std::max<size_t>(input.size() * 4, 1024));
+
+        m_inflate.next_out = reinterpret_cast<Bytef *>(output.data() + offset);
+        m_inflate.avail_out = static_cast<uInt>(output.size() - offset);
+
+        auto result = inflate(&m_inflate, Z_SYNC_FLUSH);
+        output.resize(output.size() - m_inflate.avail_out);
+
+        if (Z_OK != result && Z_BUF_ERROR != result)
+            return false;
+        if (limit < output.size())
+            return false;
+    } while (0 < m_inflate.avail_in || 0 == m_inflate.avail_out);
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "EventLoop.h"
+
+#include <algorithm>
+
+using self = EventLoop;
+
+self::EventLoop(std::chrono::milliseconds tick, size_t slots)
+    : m_origin(std::chrono::steady_clock::now()),
+      m_tick(std::max(tick, std::chrono::milliseconds(1))),
+      m_wheel(std::max<size_t>(1, slots))
+{
+}
+
+self::~EventLoop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_stopped = true;
+    curl_multi_wakeup(m_multi);
+    m_thread.join();
+
+    for (auto &[id, transfer] : m_transfers)
+        curl_multi_remove_handle(m_multi, transfer.curl);
+    curl_multi_cleanup(m_multi);
+}
+
+uint64_t self::at(std::chrono::steady_clock::time_point time, callback_t &&callback)
+{
+    start();
+
+    uint64_t id;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        // round up, a timer never fires early
+        auto elapsed = std::max(time - m_origin, std::chrono::steady_clock::duration::zero());
+        auto tick = static_cast<uint64_t>((elapsed + m_tick - std::chrono::nanoseconds(1)) / m_tick);
+        tick = std::max(tick, m_current + 1);
+
+        id = m_nextId++;
+        auto &slot = m_wheel[tick % m_wheel.size()];
+        slot.push_back({id, tick, std::move(callback)});
+        m_timers.emplace(id, std::prev(slot.end()));
+    }
+    curl_multi_wakeup(m_multi);
+
+    return id;
+}
+
+uint64_t self::after(std::chrono::milliseconds delay, callback_t &&callback)
+{
+    return at(std::chrono::steady_clock::now() + delay, std::move(callback));
+}
+
+bool self::cancel(uint64_t timer)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    auto it = m_timers.find(timer);
+    if (m_timers.end() == it)
+        return false;
+
+    m_wheel[it->second->tick % m_wheel.size()].erase(it->second);
+    m_timers.erase(it);
+
+    return true;
+}
+
+uint64_t self::perform(CURL *curl, transfer_callback_t &&callback)
+{
+    start();
+
+    uint64_t id;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        id = m_nextId++;
+        m_transferCount++;
+        m_commands.emplace_back(
+            [this, id, curl, callback = std::move(callback)]() mutable
+            {
+                if (CURLM_OK != curl_multi_add_handle(m_multi, curl))
+                {
+                    m_transferCount--;
+                    callback(CURLE_FAILED_INIT);
+                    return;
+                }
+
+                m_transfers.emplace(id, Transfer{curl, std::move(callback)});
+                m_handles.emplace(curl, id);
+            });
+    }
+    curl_multi_wakeup(m_multi);
+
+    return id;
+}
+
+void self::abort(uint64_t transfer)
+{
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        m_commands.emplace_back([this, transfer]
+                                { finish(transfer, CURLE_ABORTED_BY_CALLBACK); });
+    }
+    curl_multi_wakeup(m_multi);
+}
+
+size_t self::timers()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    return m_timers.size();
+}
+
+size_t self::transfers()
+{
+    return m_transferCount;
+}
+
+void self::start()
+{
+    std::call_once(
+        m_started,
+        [this]
+        {
+            m_multi = curl_multi_init();
+            m_thread = std::thread(&self::run, this);
+        });
+}
+
+void self::run()
+{
+    while (!m_stopped)
+    {
+        std::vector<callback_t> commands;
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+
+            commands.swap(m_commands);
+        }
+        for (auto &command : commands)
+            command();
+
+        int running = 0;
+        curl_multi_perform(m_multi, &running);
+
+        int remaining = 0;
+        while (auto message = curl_multi_info_read(m_multi, &remaining))
+        {
+            if (CURLMSG_DONE != message->msg)
+                continue;
+
+            // the message is gone once its handle is removed
+            auto curl = message->easy_handle;
+            auto result = message->data.result;
+            if (auto it = m_handles.find(curl); m_handles.end() != it)
+                finish(it->second, result);
+        }
+
+        std::vector<callback_t> due;
+        std::chrono::milliseconds timeout;
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+
+            auto now = std::chrono::steady_clock::now();
+            due = expire(now);
+            timeout = idle(now);
+        }
+        for (auto &callback : due)
+            callback();
+
+        long curlTimeout = -1;
+        curl_multi_timeout(m_multi, &curlTimeout);
+        if (0 <= curlTimeout)
+            timeout = std::min(timeout, std::chrono::milliseconds(curlTimeout));
+
+        // other threads interrupt the wait through curl_multi_wakeup(...)
+        if (due.empty() && commands.empty())
+            curl_multi_poll(m_multi, nullptr, 0, static_cast<int>(timeout.count()), nullptr);
+    }
+}
+
+std::vector<self::callback_t> self::expire(std::chrono::steady_clock::time_point now)
+{
+    std::vector<callback_t> due;
+
+    auto target = static_cast<uint64_t>((now - m_origin) / m_tick);
+    // nothing to fire on the way, skip the idle ticks
+    if (m_timers.empty())
+        m_current = std::max(m_current, target);
+
+    while (m_current < target)
+    {
+        m_current++;
+
+        auto &slot = m_wheel[m_current % m_wheel.size()];
+        for (auto it = slot.begin(); slot.end() != it;)
+        {
+            // the others belong to a later turn of the wheel
+            if (it->tick > m_current)
+            {
+                ++it;
+                continue;
+            }
+
+            due.push_back(std::move(it->callback));
+            m_timers.erase(it->id);
+            it = slot.erase(it);
+        }
+
+        if (m_timers.empty())
+            m_current = target;
+    }
+
+    return due;
+}
+
+std::chrono::milliseconds self::idle(std::chrono::steady_clock::time_point now)
+{
+    // curl_multi_wakeup(...) ends the wait early when work is added
+    constexpr auto maxIdle = std::chrono::milliseconds(1000);
+
+    if (m_timers.empty())
+        return maxIdle;
+
+    // first tick of the coming turn holding a timer that is due in it
+    auto next = m_current + m_wheel.size();
+    for (uint64_t tick = m_current + 1; tick <= m_current + m_wheel.size(); tick++)
+    {
+        auto &slot = m_wheel[tick % m_wheel.size()];
+        if (slot.end() != std::find_if(slot.begin(), slot.end(), [tick](const Timer &timer)
+                                       { return timer.tick == tick; }))
+        {
+            next = tick;
+            break;
+        }
+    }
+
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(m_origin + static_cast<int64_t>(next) * m_tick - now);
+
+    return std::clamp(wait, std::chrono::milliseconds::zero(), maxIdle);
+}
+
+void self::finish(uint64_t transfer, CURLcode result)
+{
+    auto it = m_transfers.find(transfer);
+    if (m_transfers.end() == it)
+        return;
+
+    auto callback = std::move(it->second.callback);
+    curl_multi_remove_handle(m_multi, it->second.curl);
+    m_handles.erase(it->second.curl);
+    m_transfers.erase(it);
+    m_transferCount--;
+
+    callback(result);
+}
\ No newline at end of file
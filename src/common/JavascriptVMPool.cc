@@ -0,0 +1,239 @@
+#include "JavascriptVMPool.h"
+#include "global.h"
+#include "Metrics.h"
+#include "ModuleCrypto.h"
+#include "ModuleJson.h"
+#include "ModuleRequests.h"
+#include "ModuleTools.h"
+#include "ModuleSystem.h"
+
+#include <chrono>
+#include <iterator>
+
+using self = JavascriptVMPool;
+
+namespace
+{
+    struct PoolMetrics
+    {
+        Metrics::counter_t &created = Metrics::counter("jspool.created");
+        Metrics::counter_t &reused = Metrics::counter("jspool.reused");
+        Metrics::counter_t &discarded = Metrics::counter("jspool.discarded");
+        // total microseconds spent creating runtimes
+        Metrics::counter_t &creationTime = Metrics::counter("jspool.creation_us");
+        // estimated microseconds saved by reuse, reuses times the average creation time
+        Metrics::counter_t &savedTime = Metrics::counter("jspool.saved_us");
+        // total microseconds spent binding modules, eagerly per context or lazily on first access
+        Metrics::counter_t &bindTime = Metrics::counter("jspool.bind_us");
+    };
+
+    PoolMetrics &metrics()
+    {
+        static PoolMetrics instance;
+
+        return instance;
+    }
+
+    struct LazyModule
+    {
+        const char *name;
+        void (*bind)(JSContext *context);
+    };
+
+    const LazyModule lazyModules[] = {
+        {"crypto", ModuleCrypto::bind},
+        {"json", ModuleJson::bind},
+        {"requests", ModuleRequests::bind},
+        {"system", ModuleSystem::bind},
+    };
+}
+
+self::VM::~VM()
+{
+    if (nullptr != runtime)
+        JS_FreeRuntime(runtime);
+}
+
+self::Lease self::acquire(void *loggerOptions)
+{
+    auto &vms = idle();
+    auto &counters = metrics();
+
+    std::unique_ptr<VM> vm;
+    if (!vms.empty())
+    {
+        vm = std::move(vms.back());
+        vms.pop_back();
+
+        counters.reused++;
+        if (auto created = counters.created.load(); 0 < created)
+            counters.savedTime += counters.creationTime.load() / created;
+    }
+    else
+    {
+        auto begin = std::chrono::steady_clock::now();
+        vm = create();
+        if (nullptr == vm)
+            return {nullptr, nullptr};
+
+        counters.created++;
+        counters.creationTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    auto context = newContext(vm->runtime, loggerOptions);
+
+    return {std::move(vm), context};
+}
+
+JSValue self::eval(JSContext *context, const std::string &script)
+{
+    // stripped and full bytecode must not be mixed up
+    auto key = g_javascriptScriptCache.key(g_javascriptStripDebug ? "strip\n" + script : script);
+    if (auto compiled = g_javascriptScriptCache.find(key); nullptr != compiled)
+    {
+        auto function = JS_ReadObject(context, reinterpret_cast<const uint8_t *>(compiled->data()), compiled->size(), JS_READ_OBJ_BYTECODE);
+        if (!JS_IsException(function))
+            return JS_EvalFunction(context, function);
+
+        // written by another build of quickjs, compile it again
+        JS_FreeValue(context, JS_GetException(context));
+    }
+
+#ifdef JS_STRIP_DEBUG
+    auto runtime = JS_GetRuntime(context);
+    auto stripInfo = JS_GetStripInfo(runtime);
+    if (g_javascriptStripDebug)
+        JS_SetStripInfo(runtime, JS_STRIP_DEBUG);
+    auto function = JS_Eval(context, script.c_str(), script.size(), "<input>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+    JS_SetStripInfo(runtime, stripInfo);
+#else
+    auto function = JS_Eval(context, script.c_str(), script.size(), "<input>", JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+#endif
+    if (JS_IsException(function))
+        return function;
+
+    size_t size = 0;
+    if (auto buffer = JS_WriteObject(context, &size, function, JS_WRITE_OBJ_BYTECODE); nullptr != buffer)
+    {
+        g_javascriptScriptCache.insert(key, std::string(reinterpret_cast<const char *>(buffer), size));
+        js_free(context, buffer);
+    }
+    else
+        JS_FreeValue(context, JS_GetException(context));
+
+    return JS_EvalFunction(context, function);
+}
+
+std::vector<std::unique_ptr<self::VM>> &self::idle()
+{
+    thread_local std::vector<std::unique_ptr<VM>> vms;
+
+    return vms;
+}
+
+std::unique_ptr<self::VM> self::create()
+{
+    auto vm = std::make_unique<VM>();
+
+    vm->allocator = std::make_unique<VMAllocator>(0);
+    vm->runtime = vm->allocator->newJavascriptRuntime();
+    if (nullptr == vm->runtime)
+        return nullptr;
+
+    vm->baseline = vm->allocator->used();
+
+    return vm;
+}
+
+JSContext *self::newContext(JSRuntime *runtime, void *loggerOptions)
+{
+    // quickjs cannot clone contexts, the intrinsics and modules are set up again on the shared runtime
+    auto context = JS_NewContext(runtime);
+    if (nullptr == context)
+        return nullptr;
+
+    // register modules
+    auto begin = std::chrono::steady_clock::now();
+    ModuleTools::bind(context, loggerOptions);
+    if (g_lazyModuleBinding)
+    {
+        // the other modules are accessors on the global object until their first access
+        auto global = JS_GetGlobalObject(context);
+        for (int i = 0; i < static_cast<int>(std::size(lazyModules)); i++)
+        {
+            auto atom = JS_NewAtom(context, lazyModules[i].name);
+            JS_DefinePropertyGetSet(
+                context,
+                global,
+                atom,
+                JS_NewCFunctionData(context, lazyAccessor, 0, i, 0, nullptr),
+                JS_NewCFunctionData(context, lazyAccessor, 1, i, 0, nullptr),
+                JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE);
+            JS_FreeAtom(context, atom);
+        }
+        JS_FreeValue(context, global);
+    }
+    else
+        for (auto &module : lazyModules)
+            module.bind(context);
+    metrics().bindTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    return context;
+}
+
+JSValue self::lazyAccessor(JSContext *context, JSValueConst thisValue, int argc, JSValueConst *argv, int magic, JSValue *data)
+{
+    auto &module = lazyModules[magic];
+    auto global = JS_GetGlobalObject(context);
+    auto atom = JS_NewAtom(context, module.name);
+
+    // either way the accessor is replaced by a plain property
+    JS_DeleteProperty(context, global, atom, 0);
+
+    JSValue result = JS_UNDEFINED;
+    if (0 < argc)
+    {
+        // assigned before it was read, the module is never bound
+        JS_DefinePropertyValue(context, global, atom, JS_DupValue(context, argv[0]), JS_PROP_C_W_E);
+    }
+    else
+    {
+        auto begin = std::chrono::steady_clock::now();
+        module.bind(context);
+        metrics().bindTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        result = JS_GetProperty(context, global, atom);
+    }
+
+    JS_FreeAtom(context, atom);
+    JS_FreeValue(context, global);
+
+    return result;
+}
+
+void self::release(std::unique_ptr<VM> &&vm, JSContext *context, bool discard)
+{
+    auto &vms = idle();
+
+    // the cleanup belongs to no task
+    vm->allocator->arm(0, nullptr);
+
+    if (nullptr != context)
+        JS_FreeContext(context);
+
+    // jobs left behind by an interrupted task must not run in the next one
+    if (!discard && vms.size() < maxIdle && !JS_IsJobPending(vm->runtime))
+    {
+        JS_RunGC(vm->runtime);
+
+        // keep runtimes whose heap went back near the baseline, the rest holds on to values leaked by the task
+        if (vm->allocator->used() <= vm->baseline + maxRetainedGrowth)
+        {
+            vms.push_back(std::move(vm));
+
+            return;
+        }
+    }
+
+    metrics().discarded++;
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "LogBatcher.h"
+
+using self = LogBatcher;
+
+self::LogBatcher(NetworkService &service, size_t flushSize, std::chrono::milliseconds flushDelay)
+    : m_service(service),
+      m_flushSize(flushSize),
+      m_flushDelay(flushDelay)
+{
+}
+
+void self::append(
+    uint32_t clientId,
+    uint32_t requestId,
+    uint64_t runnerId,
+    uint64_t userId,
+    uint64_t taskId,
+    std::string_view taskName,
+    uint8_t logType,
+    std::string_view message)
+{
+    if (3 > m_service.revision(clientId))
+    {
+        yasio::obstream obs;
+        auto packetSize = obs.push<uint32_t>();
+        obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::log));
+        obs.write<uint64_t>(userId);
+        obs.write<uint64_t>(taskId);
+        obs.write_byte(logType);
+        obs.write_v32(taskName);
+        obs.write_v32(message);
+        obs.pop<uint32_t>(packetSize);
+
+        m_service.backward(clientId, std::move(obs.buffer()), requestId);
+        return;
+    }
+
+    for (;;)
+    {
+        auto batch = find(clientId, true);
+
+        std::unique_lock<std::mutex> locker(batch->mutex);
+        if (batch->closed)
+            continue;
+
+        if (!batch->packet.has_value())
+        {
+            batch->packet.emplace();
+            batch->packetSize = batch->packet->push<uint32_t>();
+            batch->packet->write_byte(static_cast<uint8_t>(NetworkService::command_t::logBatch));
+
+            batch->timer = g_eventLoop.after(m_flushDelay, [this, clientId]
+                                             { flush(clientId); });
+        }
+
+        auto &packet = *batch->packet;
+        if (batch->runners.insert(runnerId).second)
+        {
+            packet.write_byte(static_cast<uint8_t>(Record::task));
+            packet.write<uint64_t>(runnerId);
+            packet.write<uint32_t>(requestId);
+            packet.write<uint64_t>(userId);
+            packet.write<uint64_t>(taskId);
+            packet.write_v32(taskName);
+        }
+        packet.write_byte(static_cast<uint8_t>(Record::line));
+        packet.write<uint64_t>(runnerId);
+        packet.write_byte(logType);
+        packet.write_v32(message);
+
+        if (m_flushSize <= static_cast<size_t>(packet.length()))
+            send(clientId, *batch);
+
+        return;
+    }
+}
+
+void self::flush(uint32_t clientId)
+{
+    auto batch = find(clientId, false);
+    if (nullptr == batch)
+        return;
+
+    std::unique_lock<std::mutex> locker(batch->mutex);
+
+    send(clientId, *batch);
+}
+
+void self::finish(uint32_t clientId, uint64_t runnerId)
+{
+    auto batch = find(clientId, false);
+    if (nullptr == batch)
+        return;
+
+    {
+        std::unique_lock<std::mutex> locker(batch->mutex);
+
+        // sent while the lock is held, so the packet is queued before the caller's result packet
+        send(clientId, *batch);
+
+        batch->runners.erase(runnerId);
+        if (!batch->runners.empty())
+            return;
+
+        batch->closed = true;
+    }
+
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    if (auto it = m_batches.find(clientId); m_batches.end() != it && batch == it->second)
+        m_batches.erase(it);
+}
+
+std::shared_ptr<self::Batch> self::find(uint32_t clientId, bool create)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    if (auto it = m_batches.find(clientId); m_batches.end() != it)
+        return it->second;
+
+    if (!create)
+        return nullptr;
+
+    return m_batches.emplace(clientId, std::make_shared<Batch>()).first->second;
+}
+
+void self::send(uint32_t clientId, Batch &batch)
+{
+    if (!batch.packet.has_value())
+        return;
+
+    // the timer of a packet sent for its size is dropped, a timer which already fired finds nothing to send
+    g_eventLoop.cancel(batch.timer);
+    batch.timer = 0;
+
+    batch.packet->pop<uint32_t>(batch.packetSize);
+    m_service.backward(clientId, std::move(batch.packet->buffer()));
+    batch.packet.reset();
+}
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "LuaCoroutine.h"
+#include "global.h"
+#include "Metrics.h"
+#include "Finally.h"
+
+using self = LuaCoroutine;
+
+namespace
+{
+    struct CoroutineMetrics
+    {
+        Metrics::counter_t &suspends = Metrics::counter("luacoroutine.suspends");
+        // tasks currently suspended, none of them holds a thread
+        Metrics::counter_t &waiting = Metrics::counter("luacoroutine.waiting");
+    };
+
+    CoroutineMetrics &metrics()
+    {
+        static CoroutineMetrics instance;
+
+        return instance;
+    }
+
+    struct PushResults
+    {
+        const self::results_t *results;
+        lua_State *thread;
+    };
+}
+
+self::LuaCoroutine(lua_State *luaState, TaskControl *control, finished_t &&finished)
+    : m_state(luaState),
+      m_thread(lua_newthread(luaState)),
+      m_reference(luaL_ref(luaState, LUA_REGISTRYINDEX)),
+      m_control(control),
+      m_finished(std::move(finished))
+{
+}
+
+void self::start(lua_State *luaState, int arguments, TaskControl *control, finished_t &&finished)
+{
+    auto coroutine = std::make_shared<LuaCoroutine>(luaState, control, std::move(finished));
+    coroutine->m_context = Scheduler::current();
+
+    lua_xmove(luaState, coroutine->m_thread, arguments + 1);
+    coroutine->run(arguments);
+}
+
+bool self::suspendable(lua_State *luaState)
+{
+    return g_luaCoroutines && nullptr != t_current && luaState == t_current->m_thread && 0 != lua_isyieldable(luaState);
+}
+
+int self::suspend(lua_State *luaState, wait_t &&wait)
+{
+    // checked before the wait starts, a failed yield would leak it
+    if (!suspendable(luaState))
+        return luaL_error(luaState, "attempt to suspend outside a coroutine task");
+
+    auto coroutine = t_current->shared_from_this();
+
+    uint64_t id;
+    {
+        std::unique_lock<std::mutex> locker(coroutine->m_mutex);
+
+        id = ++coroutine->m_wait;
+        coroutine->m_completed = false;
+        coroutine->m_results = nullptr;
+    }
+    coroutine->m_arrivals = 2;
+    coroutine->m_suspended = true;
+
+    complete_t complete = [coroutine, id](results_t &&results)
+    {
+        coroutine->complete(id, std::move(results));
+    };
+
+    // interrupts and the deadline complete the wait without results
+    coroutine->m_control->setCallback([complete]
+                                      { complete(nullptr); });
+    if (auto deadline = coroutine->m_control->deadline(); std::chrono::steady_clock::time_point::max() != deadline)
+        coroutine->m_deadlineTimer = g_eventLoop.at(deadline, [complete]
+                                                    { complete(nullptr); });
+
+    // read by take() only after this thread arrived as well
+    coroutine->m_cancel = wait(complete);
+
+    auto &counters = metrics();
+    counters.suspends++;
+    counters.waiting++;
+
+    return lua_yield(luaState, 0);
+}
+
+void self::run(int arguments)
+{
+    auto previous = t_current;
+    t_current = this;
+    finally
+    {
+        t_current = previous;
+    };
+
+    TaskControl::Scope controlScope(m_control);
+    m_control->attach();
+
+    for (;;)
+    {
+        auto status = LUA_ERRRUN;
+        if (0 <= arguments)
+        {
+            m_suspended = false;
+            status = lua_resume(m_thread, arguments);
+        }
+
+        if (LUA_YIELD == status && m_suspended)
+        {
+            m_control->detach();
+
+            // the wait is still running, whoever completes it continues the coroutine
+            if (1 != m_arrivals.fetch_sub(1, std::memory_order_acq_rel))
+                return;
+
+            m_control->attach();
+            arguments = take();
+            continue;
+        }
+
+        // a yield of the script itself, e.g. coroutine.yield() at the top level of the task
+        if (LUA_YIELD == status)
+        {
+            lua_settop(m_thread, 0);
+            lua_pushstring(m_thread, "attempt to yield from outside a coroutine");
+            status = LUA_ERRRUN;
+        }
+
+        auto finished = std::move(m_finished);
+        finished(status, m_thread);
+
+        // the callback may own the vm, so the coroutine is released before it
+        luaL_unref(m_state, LUA_REGISTRYINDEX, m_reference);
+        m_reference = LUA_NOREF;
+
+        return;
+    }
+}
+
+int self::take()
+{
+    m_control->setCallback(nullptr);
+    if (0 != m_deadlineTimer)
+        g_eventLoop.cancel(m_deadlineTimer);
+    m_deadlineTimer = 0;
+
+    results_t results;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        results = std::move(m_results);
+    }
+
+    // stop what the wait started, e.g. a transfer which is still running after an interrupt
+    if (nullptr != m_cancel)
+        m_cancel();
+    m_cancel = nullptr;
+
+    metrics().waiting--;
+
+    // without results the wait was cut short by an interrupt or the deadline
+    if (nullptr == results)
+        m_control->poll();
+    if (m_control->interrupted())
+    {
+        lua_settop(m_thread, 0);
+        lua_pushstring(m_thread, "task interrupted");
+
+        return -1;
+    }
+    if (nullptr == results)
+        return 0;
+
+    // the results may run out of memory, push them in protected mode on the main thread
+    PushResults push{&results, m_thread};
+    auto top = lua_gettop(m_thread);
+    auto status = lua_cpcall(
+        m_state,
+        [](lua_State *luaState) -> int
+        {
+            auto push = static_cast<PushResults *>(lua_touserdata(luaState, 1));
+            lua_pop(luaState, 1);
+
+            auto count = (*push->results)(luaState);
+            lua_xmove(luaState, push->thread, count);
+
+            return 0;
+        },
+        &push);
+    if (0 != status)
+    {
+        lua_settop(m_thread, 0);
+        lua_xmove(m_state, m_thread, 1);
+
+        return -1;
+    }
+
+    return lua_gettop(m_thread) - top;
+}
+
+void self::complete(uint64_t wait, results_t &&results)
+{
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        // a late completion of an earlier wait
+        if (wait != m_wait || m_completed)
+            return;
+
+        m_completed = true;
+        m_results = std::move(results);
+    }
+
+    if (1 != m_arrivals.fetch_sub(1, std::memory_order_acq_rel))
+        return;
+
+    auto resume = [coroutine = shared_from_this()]
+    { coroutine->run(coroutine->take()); };
+
+    // resumed work waits for a slot and counts against the fair share of the user like a new job
+    if (m_context.has_value())
+        Scheduler::resume(*m_context, std::move(resume));
+    else
+        g_threadPool.submit(std::move(resume));
+}
\ No newline at end of file
@@ -0,0 +1,438 @@
+#include "LuaVMPool.h"
+#include "global.h"
+#include "Metrics.h"
+#include "ModuleCrypto.h"
+#include "ModuleJson.h"
+#include "ModuleRequests.h"
+#include "ModuleTools.h"
+#include "ModuleSystem.h"
+
+#include <chrono>
+#include <cstring>
+
+using self = LuaVMPool;
+
+namespace
+{
+    struct PoolMetrics
+    {
+        Metrics::counter_t &created = Metrics::counter("luapool.created");
+        Metrics::counter_t &reused = Metrics::counter("luapool.reused");
+        Metrics::counter_t &discarded = Metrics::counter("luapool.discarded");
+        // total microseconds spent creating vms
+        Metrics::counter_t &creationTime = Metrics::counter("luapool.creation_us");
+        // estimated microseconds saved by reuse, reuses times the average creation time
+        Metrics::counter_t &savedTime = Metrics::counter("luapool.saved_us");
+        // total microseconds spent binding modules, eagerly on creation or lazily on first access
+        Metrics::counter_t &bindTime = Metrics::counter("luapool.bind_us");
+    };
+
+    PoolMetrics &metrics()
+    {
+        static PoolMetrics instance;
+
+        return instance;
+    }
+
+    struct LazyModule
+    {
+        const char *name;
+        void (*bind)(lua_State *luaState);
+    };
+
+    const LazyModule lazyModules[] = {
+        {"crypto", ModuleCrypto::bind},
+        {"json", ModuleJson::bind},
+        {"requests", ModuleRequests::bind},
+        {"system", ModuleSystem::bind},
+    };
+
+    // the snapshot is also kept here, so that lazily bound modules can join it
+    constexpr auto snapshotKey = "LuaVMPool.snapshot";
+
+    constexpr auto runnerKey = "LuaVMPool.runner";
+
+    // runner(chunk, passport, methods...), returns the result of the last method or nil, name, reason.
+    // the globals are captured, so that a script assigning _G does not hide its methods
+    constexpr auto runnerSource = R"(
+        local globals, select, type = _G, select, type
+
+        return function(chunk, passport, ...)
+            local result = false
+
+            if nil ~= chunk then
+                chunk()
+
+                if "function" ~= type(globals.setTaskPassport) then
+                    return nil, "setTaskPassport", "is not a function"
+                end
+                globals.setTaskPassport(passport)
+            end
+
+            for i = 1, select("#", ...) do
+                local name = select(i, ...)
+                local method = globals[name]
+                if "function" ~= type(method) then
+                    return nil, name, "is not a function"
+                end
+
+                result = method()
+                if "boolean" ~= type(result) then
+                    return nil, name, "return value is not a boolean"
+                end
+            end
+
+            return result
+        end
+    )";
+}
+
+self::VM::~VM()
+{
+    if (nullptr != state)
+        lua_close(state);
+}
+
+self::Lease self::acquire(void *loggerOptions, const StickyTicket *ticket)
+{
+    auto &vms = idle();
+    auto &counters = metrics();
+
+    std::unique_ptr<VM> vm;
+    if (nullptr != ticket)
+        vm = sticky().take(*ticket);
+
+    auto warm = nullptr != vm;
+    if (!warm && !vms.empty())
+    {
+        vm = std::move(vms.back());
+        vms.pop_back();
+
+        counters.reused++;
+        if (auto created = counters.created.load(); 0 < created)
+            counters.savedTime += counters.creationTime.load() / created;
+    }
+    else if (!warm)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        vm = create();
+        if (nullptr == vm)
+            return {nullptr};
+
+        counters.created++;
+        counters.creationTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // the logger finds its task through this option
+    ModuleTools::bind(vm->state, loggerOptions);
+
+    return {std::move(vm), ticket, warm};
+}
+
+bool self::invalidate(uint64_t userId, uint64_t taskId)
+{
+    return sticky().invalidate(userId, taskId);
+}
+
+void self::pushRunner(lua_State *luaState)
+{
+    lua_getfield(luaState, LUA_REGISTRYINDEX, runnerKey);
+}
+
+int self::load(lua_State *luaState, const std::string &script)
+{
+    // the source doubles as chunk name, so errors keep the `[string "..."]` form of luaL_dostring
+    auto key = g_luaScriptCache.key(script);
+    if (auto compiled = g_luaScriptCache.find(key); nullptr != compiled)
+    {
+        if (auto status = luaL_loadbufferx(luaState, compiled->data(), compiled->size(), script.c_str(), "b"); LUA_OK == status)
+            return status;
+
+        // written by another build of luajit, e.g. one with GC64 switched, compile it again
+        lua_pop(luaState, 1);
+        g_luaScriptCache.erase(key);
+    }
+
+    // sources are text only, precompiled chunks are never accepted from a task
+    auto status = luaL_loadbufferx(luaState, script.data(), script.size(), script.c_str(), "t");
+    if (LUA_OK != status)
+        return status;
+
+    std::string compiled;
+    auto writer = [](lua_State *, const void *data, size_t size, void *userData) -> int
+    {
+        static_cast<std::string *>(userData)->append(static_cast<const char *>(data), size);
+        return 0;
+    };
+    if (0 == lua_dump(luaState, writer, &compiled))
+        g_luaScriptCache.insert(key, std::move(compiled));
+
+    return status;
+}
+
+std::vector<std::unique_ptr<self::VM>> &self::idle()
+{
+    thread_local std::vector<std::unique_ptr<VM>> vms;
+
+    return vms;
+}
+
+std::unique_ptr<self::VM> self::create()
+{
+    auto vm = std::make_unique<VM>();
+
+    vm->allocator = std::make_unique<VMAllocator>(0);
+    vm->state = vm->allocator->newLuaState();
+    if (nullptr == vm->state)
+        return nullptr;
+
+    // initialization environment
+    luaL_openlibs(vm->state);
+    if (!g_luaJit)
+        luaJIT_setmode(vm->state, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+
+    // register modules, the logger is bound again for every task anyway
+    auto begin = std::chrono::steady_clock::now();
+    ModuleTools::bind(vm->state);
+    if (g_lazyModuleBinding)
+    {
+        // the other modules are bound on first access through the globals
+        lua_createtable(vm->state, 0, 1);
+        lua_pushcfunction(vm->state, lazyIndex);
+        lua_setfield(vm->state, -2, "__index");
+        lua_setmetatable(vm->state, LUA_GLOBALSINDEX);
+    }
+    else
+        for (auto &module : lazyModules)
+            module.bind(vm->state);
+    metrics().bindTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    // compiled once per vm, a task only looks it up
+    if (0 != luaL_loadbuffer(vm->state, runnerSource, std::strlen(runnerSource), "=runner") || 0 != lua_pcall(vm->state, 0, 1, 0))
+        return nullptr;
+    lua_setfield(vm->state, LUA_REGISTRYINDEX, runnerKey);
+
+    vm->snapshot = snapshot(vm->state);
+    lua_rawgeti(vm->state, LUA_REGISTRYINDEX, vm->snapshot);
+    lua_setfield(vm->state, LUA_REGISTRYINDEX, snapshotKey);
+    lua_gc(vm->state, LUA_GCCOLLECT, 0);
+    vm->baseline = vm->allocator->used();
+
+    return vm;
+}
+
+StickyCache<self::VM> &self::sticky()
+{
+    // dropped warm vms are closed, their state belongs to the task
+    static StickyCache<VM> instance("luasticky", g_stickyMemoryLimit, g_stickyMaxVMs, [](std::unique_ptr<VM> &&vm)
+                                    { vm.reset(); });
+
+    return instance;
+}
+
+void self::release(std::unique_ptr<VM> &&vm, bool discard, const StickyTicket *ticket)
+{
+    auto &vms = idle();
+
+    if (!discard && nullptr != ticket)
+    {
+        // nothing is scrubbed, the next run of the task continues with this state
+        vm->allocator->arm(0, nullptr);
+
+        lua_settop(vm->state, 0);
+        lua_gc(vm->state, LUA_GCCOLLECT, 0);
+
+        auto size = vm->allocator->used();
+        sticky().put(*ticket, std::move(vm), size);
+
+        return;
+    }
+
+    if (!discard && vms.size() < maxIdle)
+    {
+        // the scrub belongs to no task
+        vm->allocator->arm(0, nullptr);
+
+        restore(vm->state, vm->snapshot);
+        lua_settop(vm->state, 0);
+        lua_gc(vm->state, LUA_GCCOLLECT, 0);
+
+        // keep vms whose heap went back near the baseline, the rest holds on to something we did not scrub
+        if (vm->allocator->used() <= vm->baseline + maxRetainedGrowth)
+        {
+            vms.push_back(std::move(vm));
+
+            return;
+        }
+    }
+
+    metrics().discarded++;
+}
+
+int self::snapshot(lua_State *luaState)
+{
+    // snapshot = {[1] = {[table] = shallow copy}, [2] = {[table] = metatable}}
+    lua_createtable(luaState, 2, 0);
+    auto holder = lua_gettop(luaState);
+    lua_newtable(luaState);
+    auto contents = lua_gettop(luaState);
+    lua_newtable(luaState);
+    auto metatables = lua_gettop(luaState);
+
+    auto record = [&](int table)
+    {
+        self::record(luaState, contents, metatables, table);
+    };
+
+    // the globals, the library and module tables below them and the loaded modules
+    lua_pushvalue(luaState, LUA_GLOBALSINDEX);
+    auto globals = lua_gettop(luaState);
+    record(globals);
+
+    lua_pushnil(luaState);
+    while (0 != lua_next(luaState, globals))
+    {
+        if (lua_istable(luaState, -1))
+            record(lua_gettop(luaState));
+        lua_pop(luaState, 1);
+    }
+
+    lua_getfield(luaState, LUA_REGISTRYINDEX, "_LOADED");
+    if (lua_istable(luaState, -1))
+        record(lua_gettop(luaState));
+    lua_pop(luaState, 2);
+
+    lua_rawseti(luaState, holder, 2);
+    lua_rawseti(luaState, holder, 1);
+
+    return luaL_ref(luaState, LUA_REGISTRYINDEX);
+}
+
+void self::record(lua_State *luaState, int contents, int metatables, int table)
+{
+    lua_pushvalue(luaState, table);
+    lua_newtable(luaState);
+    auto copy = lua_gettop(luaState);
+
+    lua_pushnil(luaState);
+    while (0 != lua_next(luaState, table))
+    {
+        lua_pushvalue(luaState, -2);
+        lua_insert(luaState, -2);
+        lua_rawset(luaState, copy);
+    }
+    lua_rawset(luaState, contents);
+
+    if (0 != lua_getmetatable(luaState, table))
+    {
+        lua_pushvalue(luaState, table);
+        lua_insert(luaState, -2);
+        lua_rawset(luaState, metatables);
+    }
+}
+
+int self::lazyIndex(lua_State *luaState)
+{
+    // __index(table, key), only names of modules are resolved
+    if (LUA_TSTRING != lua_type(luaState, 2))
+        return 0;
+
+    auto name = lua_tostring(luaState, 2);
+    for (auto &module : lazyModules)
+    {
+        if (0 != std::strcmp(module.name, name))
+            continue;
+
+        auto begin = std::chrono::steady_clock::now();
+        module.bind(luaState);
+        metrics().bindTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        // the module becomes part of the pristine state, so it survives the scrub after this task
+        lua_getfield(luaState, LUA_REGISTRYINDEX, snapshotKey);
+        if (lua_istable(luaState, -1))
+        {
+            auto holder = lua_gettop(luaState);
+            lua_rawgeti(luaState, holder, 1);
+            auto contents = lua_gettop(luaState);
+            lua_rawgeti(luaState, holder, 2);
+            auto metatables = lua_gettop(luaState);
+
+            lua_pushvalue(luaState, LUA_GLOBALSINDEX);
+            lua_rawget(luaState, contents);
+            lua_pushvalue(luaState, 2);
+            lua_pushvalue(luaState, 2);
+            lua_rawget(luaState, LUA_GLOBALSINDEX);
+            lua_rawset(luaState, -3);
+            lua_pop(luaState, 1);
+
+            lua_pushvalue(luaState, 2);
+            lua_rawget(luaState, LUA_GLOBALSINDEX);
+            if (lua_istable(luaState, -1))
+                record(luaState, contents, metatables, lua_gettop(luaState));
+            lua_pop(luaState, 1);
+
+            lua_pop(luaState, 2);
+        }
+        lua_pop(luaState, 1);
+
+        lua_pushvalue(luaState, 2);
+        lua_rawget(luaState, LUA_GLOBALSINDEX);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+void self::restore(lua_State *luaState, int snapshot)
+{
+    lua_rawgeti(luaState, LUA_REGISTRYINDEX, snapshot);
+    auto holder = lua_gettop(luaState);
+    lua_rawgeti(luaState, holder, 1);
+    auto contents = lua_gettop(luaState);
+    lua_rawgeti(luaState, holder, 2);
+    auto metatables = lua_gettop(luaState);
+
+    lua_pushnil(luaState);
+    while (0 != lua_next(luaState, contents))
+    {
+        auto copy = lua_gettop(luaState);
+        auto table = copy - 1;
+
+        // drop the fields added by the task, clearing existing fields while traversing is allowed
+        lua_pushnil(luaState);
+        while (0 != lua_next(luaState, table))
+        {
+            lua_pop(luaState, 1);
+            lua_pushvalue(luaState, -1);
+            lua_rawget(luaState, copy);
+            auto added = lua_isnil(luaState, -1);
+            lua_pop(luaState, 1);
+
+            if (added)
+            {
+                lua_pushvalue(luaState, -1);
+                lua_pushnil(luaState);
+                lua_rawset(luaState, table);
+            }
+        }
+
+        // put back the original values
+        lua_pushnil(luaState);
+        while (0 != lua_next(luaState, copy))
+        {
+            lua_pushvalue(luaState, -2);
+            lua_insert(luaState, -2);
+            lua_rawset(luaState, table);
+        }
+
+        // and the original metatable, nil removes one set by the task
+        lua_pushvalue(luaState, table);
+        lua_rawget(luaState, metatables);
+        lua_setmetatable(luaState, table);
+
+        lua_pop(luaState, 1);
+    }
+
+    lua_settop(luaState, holder - 1);
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "Metrics.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Metrics::Detail
+{
+    struct Registry
+    {
+        std::mutex mutex;
+        std::map<std::string, std::unique_ptr<counter_t>> counters;
+        std::map<std::string, gauge_t> gauges;
+    };
+
+    Registry &registry()
+    {
+        static Registry instance;
+
+        return instance;
+    }
+}
+
+namespace Metrics
+{
+    counter_t &counter(const std::string &name)
+    {
+        auto &registry = Detail::registry();
+        std::unique_lock<std::mutex> locker(registry.mutex);
+
+        auto &counter = registry.counters[name];
+        if (nullptr == counter)
+            counter = std::make_unique<counter_t>(0);
+
+        return *counter;
+    }
+
+    void gauge(const std::string &name, gauge_t &&gauge)
+    {
+        auto &registry = Detail::registry();
+        std::unique_lock<std::mutex> locker(registry.mutex);
+
+        registry.gauges[name] = std::move(gauge);
+    }
+
+    std::vector<std::pair<std::string, int64_t>> snapshot()
+    {
+        auto &registry = Detail::registry();
+        std::unique_lock<std::mutex> locker(registry.mutex);
+
+        std::vector<std::pair<std::string, int64_t>> result;
+        result.reserve(registry.counters.size() + registry.gauges.size());
+
+        for (const auto &[name, counter] : registry.counters)
+            result.emplace_back(name, counter->load());
+        for (const auto &[name, gauge] : registry.gauges)
+            result.emplace_back(name, gauge());
+
+        return result;
+    }
+}
\ No newline at end of file
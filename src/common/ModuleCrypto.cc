@@ -181,7 +181,7 @@ namespace ModuleCrypto::Bindings
                 seed = args[2].cast<std::string>();
         }
 
-        auto keyPair = rsaGenerateKeyPair(keySize, hex, seed);
+        auto keyPair = common::pythonWithoutGil(rsaGenerateKeyPair, keySize, hex, seed);
         pybind11::dict result;
 
         result["publicKey"] = keyPair.first;
@@ -250,19 +250,19 @@ namespace ModuleCrypto
         cryptoModule.def("utf8ToGBK", &utf8ToGBK);
         cryptoModule.def("urlEncode", &urlEncode);
         cryptoModule.def("urlDecode", &urlDecode);
-        cryptoModule.def("base64Encode", &base64Encode);
-        cryptoModule.def("base64Decode", &base64Decode);
-        cryptoModule.def("md5", &md5);
-        cryptoModule.def("sha1", &sha1);
-        cryptoModule.def("sha256", &sha256);
-        cryptoModule.def("sha512", &sha512);
-        cryptoModule.def("aesEncrypt", &aesEncrypt);
-        cryptoModule.def("aesDecrypt", &aesDecrypt);
-        cryptoModule.def("desEncrypt", &desEncrypt);
-        cryptoModule.def("desDecrypt", &desDecrypt);
+        cryptoModule.def("base64Encode", &base64Encode, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("base64Decode", &base64Decode, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("md5", &md5, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("sha1", &sha1, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("sha256", &sha256, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("sha512", &sha512, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("aesEncrypt", &aesEncrypt, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("aesDecrypt", &aesDecrypt, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("desEncrypt", &desEncrypt, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("desDecrypt", &desDecrypt, pybind11::call_guard<pybind11::gil_scoped_release>());
         cryptoModule.def("rsaGenerateKeyPair", &Bindings::pyRsaGenerateKeyPair);
-        cryptoModule.def("rsaEncrypt", &rsaEncrypt);
-        cryptoModule.def("rsaDecrypt", &rsaDecrypt);
+        cryptoModule.def("rsaEncrypt", &rsaEncrypt, pybind11::call_guard<pybind11::gil_scoped_release>());
+        cryptoModule.def("rsaDecrypt", &rsaDecrypt, pybind11::call_guard<pybind11::gil_scoped_release>());
     }
 
     void bind(JSContext *context)
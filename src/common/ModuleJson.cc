@@ -244,9 +244,15 @@ namespace ModuleJson::Bindings
     pybind11::object python_loads(const std::string &data)
     {
         Detail::JsonReader reader(PyEval_GetGlobals());
-        rapidjson::StringStream dataStream(data.data());
+        rapidjson::Document document;
 
-        rapidjson::Reader{}.Parse(dataStream, reader);
+        // parse without the gil, only building the python objects needs it
+        common::pythonWithoutGil([&]
+                                 { document.Parse(data.data(), data.size()); });
+        if (document.HasParseError())
+            throw std::runtime_error(std::string("json.loads: ") + rapidjson::GetParseError_En(document.GetParseError()));
+
+        document.Accept(reader);
 
         return reader;
     }
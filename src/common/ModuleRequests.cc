@@ -2,7 +2,44 @@
 
 namespace ModuleRequests::Detail
 {
-    RequestResult request(CURL *curl, const std::string &url, const std::string &data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout)
+    CURLcode perform(CURL *curl)
+    {
+        auto control = TaskControl::current();
+        if (nullptr == control)
+            return curl_easy_perform(curl);
+
+        // drive the transfer through a multi handle so that an interrupt is noticed within one poll interval
+        CURLM *multi = curl_multi_init();
+        curl_multi_add_handle(multi, curl);
+
+        CURLcode result = CURLE_ABORTED_BY_CALLBACK;
+        int running = 1;
+        while (!control->poll())
+        {
+            if (CURLM_OK != curl_multi_perform(multi, &running))
+            {
+                result = CURLE_FAILED_INIT;
+                break;
+            }
+            if (0 == running)
+            {
+                int remaining = 0;
+                auto message = curl_multi_info_read(multi, &remaining);
+
+                result = nullptr != message && CURLMSG_DONE == message->msg ? message->data.result : CURLE_FAILED_INIT;
+                break;
+            }
+
+            curl_multi_poll(multi, nullptr, 0, 50, nullptr);
+        }
+
+        curl_multi_remove_handle(multi, curl);
+        curl_multi_cleanup(multi);
+
+        return result;
+    }
+
+    curl_slist *setup(CURL *curl, const std::string &url, const std::string &data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout, RequestResult &result)
     {
         curl_slist *sendHeaders = nullptr;
 
@@ -95,27 +132,112 @@ namespace ModuleRequests::Detail
             });
 
         // set response user data
-        RequestResult result;
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result.content);
         curl_easy_setopt(curl, CURLOPT_HEADERDATA, &result.headers);
 
-        // perform request
-        auto status = curl_easy_perform(curl);
+        return sendHeaders;
+    }
+
+    void complete(CURL *curl, CURLcode status, RequestResult &result)
+    {
         result.success = CURLE_OK == status;
         if (result.success)
             result.errorMessage = curl_easy_strerror(status);
 
         // get response code
         curl_easy_getinfo(curl, CURLINFO_HTTP_CODE, &result.code);
+    }
+
+    RequestResult request(CURL *curl, const std::string &url, const std::string &data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout)
+    {
+        RequestResult result;
+        auto sendHeaders = setup(curl, url, data, isJson, headers, proxy, redirect, timeout, result);
+
+        // perform request
+        CURLcode status;
+        {
+            ThreadPool::BlockingScope blocking;
+
+            status = perform(curl);
+        }
+        complete(curl, status, result);
         curl_slist_free_all(sendHeaders);
 
         return result;
     }
+
+    void luaPushResult(lua_State *luaState, const RequestResult &result)
+    {
+        lua_createtable(luaState, 0, 5);
+
+        lua_pushboolean(luaState, result.success);
+        lua_setfield(luaState, -2, "success");
+        lua_pushlstring(luaState, result.errorMessage.data(), result.errorMessage.size());
+        lua_setfield(luaState, -2, "errorMessage");
+        lua_pushinteger(luaState, result.code);
+        lua_setfield(luaState, -2, "code");
+
+        lua_createtable(luaState, 0, static_cast<int>(result.headers.size()));
+        for (auto &header : result.headers)
+        {
+            lua_pushlstring(luaState, header.second.data(), header.second.size());
+            lua_setfield(luaState, -2, header.first.c_str());
+        }
+        lua_setfield(luaState, -2, "headers");
+
+        lua_pushlstring(luaState, result.content.data(), result.content.size());
+        lua_setfield(luaState, -2, "content");
+    }
+
+    int luaRequest(lua_State *luaState, const char *method, const std::string &url, std::string &&data, bool isJson, const headers_t &headers, const std::string &proxy, bool redirect, size_t timeout)
+    {
+        auto transfer = std::make_shared<Transfer>();
+        transfer->data = std::move(data);
+
+        curl_easy_setopt(transfer->curl, CURLOPT_CUSTOMREQUEST, method);
+        transfer->headers = setup(transfer->curl, url, transfer->data, isJson, headers, proxy, redirect, timeout, transfer->result);
+
+        if (!LuaCoroutine::suspendable(luaState))
+        {
+            CURLcode status;
+            {
+                ThreadPool::BlockingScope blocking;
+
+                status = perform(transfer->curl);
+            }
+            complete(transfer->curl, status, transfer->result);
+            luaPushResult(luaState, transfer->result);
+
+            return 1;
+        }
+
+        return LuaCoroutine::suspend(
+            luaState,
+            [transfer](const LuaCoroutine::complete_t &completeWait)
+            {
+                auto id = g_eventLoop.perform(
+                    transfer->curl,
+                    [transfer, completeWait](CURLcode status)
+                    {
+                        complete(transfer->curl, status, transfer->result);
+                        completeWait(
+                            [transfer](lua_State *luaState)
+                            {
+                                luaPushResult(luaState, transfer->result);
+
+                                return 1;
+                            });
+                    });
+
+                return std::function<void()>([id]
+                                             { g_eventLoop.abort(id); });
+            });
+    }
 }
 
 namespace ModuleRequests::Bindings
 {
-    luabridge::LuaRef luaGet(lua_State *luaState)
+    int luaGet(lua_State *luaState)
     {
         auto paramsCount = lua_gettop(luaState);
         if (1 > paramsCount)
@@ -123,26 +245,19 @@ namespace ModuleRequests::Bindings
         if (1 < paramsCount && LUA_TTABLE != lua_type(luaState, 2))
             luaL_error(luaState, "requests.get(...){...} ==> the 2 parameter \"headers\" must a table");
 
-        auto response = get(
+        return Detail::luaRequest(
+            luaState,
+            "GET",
             lua_tostring(luaState, 1),
+            "",
+            false,
             2 <= paramsCount ? common::luaTableToMap(luaState, 2) : std::unordered_map<std::string, std::string>{},
             3 <= paramsCount ? lua_tostring(luaState, 3) : "",
             4 <= paramsCount ? lua_toboolean(luaState, 4) : true,
             5 <= paramsCount ? lua_tointeger(luaState, 5) : 100000);
-
-        luabridge::LuaRef result(luaState, luabridge::newTable(luaState));
-        result["success"] = response.success;
-        result["errorMessage"] = response.errorMessage;
-        result["code"] = response.code;
-        result["headers"] = luabridge::newTable(luaState);
-        for (auto header : response.headers)
-            result["headers"][header.first] = header.second;
-        result["content"] = response.content;
-
-        return result;
     }
 
-    luabridge::LuaRef luaPost(lua_State *luaState)
+    int luaPost(lua_State *luaState)
     {
         auto paramsCount = lua_gettop(luaState);
         if (2 > paramsCount)
@@ -151,7 +266,9 @@ namespace ModuleRequests::Bindings
             luaL_error(luaState, "requests.post(...){...} ==> the 3 parameter \"headers\" must a table");
 
         auto isDataJson = LUA_TTABLE == lua_type(luaState, 2);
-        auto response = post(
+        return Detail::luaRequest(
+            luaState,
+            "POST",
             lua_tostring(luaState, 1),
             isDataJson ? common::luaTableToJson(luaState, 2) : lua_tostring(luaState, 2),
             isDataJson,
@@ -159,20 +276,9 @@ namespace ModuleRequests::Bindings
             4 <= paramsCount ? lua_tostring(luaState, 4) : "",
             5 <= paramsCount ? lua_toboolean(luaState, 5) : true,
             6 <= paramsCount ? lua_tointeger(luaState, 6) : 100000);
-
-        luabridge::LuaRef result(luaState, luabridge::newTable(luaState));
-        result["success"] = response.success;
-        result["errorMessage"] = response.errorMessage;
-        result["code"] = response.code;
-        result["headers"] = luabridge::newTable(luaState);
-        for (auto header : response.headers)
-            result["headers"][header.first] = header.second;
-        result["content"] = response.content;
-
-        return result;
     }
 
-    luabridge::LuaRef luaPut(lua_State *luaState)
+    int luaPut(lua_State *luaState)
     {
         auto paramsCount = lua_gettop(luaState);
         if (2 > paramsCount)
@@ -181,7 +287,9 @@ namespace ModuleRequests::Bindings
             luaL_error(luaState, "requests.put(...){...} ==> the 3 parameter \"headers\" must a table");
 
         auto isDataJson = LUA_TTABLE == lua_type(luaState, 2);
-        auto response = put(
+        return Detail::luaRequest(
+            luaState,
+            "PUT",
             lua_tostring(luaState, 1),
             isDataJson ? common::luaTableToJson(luaState, 2) : lua_tostring(luaState, 2),
             isDataJson,
@@ -189,20 +297,9 @@ namespace ModuleRequests::Bindings
             4 <= paramsCount ? lua_tostring(luaState, 4) : "",
             5 <= paramsCount ? lua_toboolean(luaState, 5) : true,
             6 <= paramsCount ? lua_tointeger(luaState, 6) : 100000);
-
-        luabridge::LuaRef result(luaState, luabridge::newTable(luaState));
-        result["success"] = response.success;
-        result["errorMessage"] = response.errorMessage;
-        result["code"] = response.code;
-        result["headers"] = luabridge::newTable(luaState);
-        for (auto header : response.headers)
-            result["headers"][header.first] = header.second;
-        result["content"] = response.content;
-
-        return result;
     }
 
-    luabridge::LuaRef luaDelete(lua_State *luaState)
+    int luaDelete(lua_State *luaState)
     {
         auto paramsCount = lua_gettop(luaState);
         if (1 > paramsCount)
@@ -210,23 +307,16 @@ namespace ModuleRequests::Bindings
         if (1 < paramsCount && LUA_TTABLE != lua_type(luaState, 2))
             luaL_error(luaState, "requests.delete(...){...} ==> the 2 parameter \"headers\" must a table");
 
-        auto response = delete_(
+        return Detail::luaRequest(
+            luaState,
+            "DELETE",
             lua_tostring(luaState, 1),
+            "",
+            false,
             2 <= paramsCount ? common::luaTableToMap(luaState, 2) : std::unordered_map<std::string, std::string>{},
             3 <= paramsCount ? lua_tostring(luaState, 3) : "",
             4 <= paramsCount ? lua_toboolean(luaState, 4) : true,
             5 <= paramsCount ? lua_tointeger(luaState, 5) : 100000);
-
-        luabridge::LuaRef result(luaState, luabridge::newTable(luaState));
-        result["success"] = response.success;
-        result["errorMessage"] = response.errorMessage;
-        result["code"] = response.code;
-        result["headers"] = luabridge::newTable(luaState);
-        for (auto header : response.headers)
-            result["headers"][header.first] = header.second;
-        result["content"] = response.content;
-
-        return result;
     }
 
     pybind11::dict pyGet(pybind11::args args)
@@ -236,7 +326,8 @@ namespace ModuleRequests::Bindings
         if (1 < args.size() && !PyDict_Check(args[1].ptr()))
             throw std::runtime_error("requests.get(...){...} ==> the 2 parameter \"headers\" must a dict");
 
-        auto response = get(
+        auto response = common::pythonWithoutGil(
+            get,
             args[0].cast<std::string>(),
             2 <= args.size() ? common::pythonDictToMap(args[1].cast<pybind11::dict>()) : std::unordered_map<std::string, std::string>{},
             3 <= args.size() ? args[2].cast<std::string>() : "",
@@ -263,9 +354,10 @@ namespace ModuleRequests::Bindings
             throw std::runtime_error("requests.post(...){...} ==> the 3 parameter \"headers\" must a dict");
 
         auto isDataJson = PyDict_Check(args[1].ptr());
-        auto response = post(
+        auto response = common::pythonWithoutGil(
+            post,
             args[0].cast<std::string>(),
-            isDataJson ? common::pythonDictToJson(args[1].cast<pybind11::dict>()) : PyUnicode_AsUTF8(args[1].ptr()),
+            isDataJson ? common::pythonDictToJson(args[1].cast<pybind11::dict>()) : std::string(PyUnicode_AsUTF8(args[1].ptr())),
             isDataJson,
             3 <= args.size() ? common::pythonDictToMap(args[2].cast<pybind11::dict>()) : std::unordered_map<std::string, std::string>{},
             4 <= args.size() ? args[3].cast<std::string>() : "",
@@ -292,9 +384,10 @@ namespace ModuleRequests::Bindings
             throw std::runtime_error("requests.put(...){...} ==> the 3 parameter \"headers\" must a dict");
 
         auto isDataJson = PyDict_Check(args[1].ptr());
-        auto response = put(
+        auto response = common::pythonWithoutGil(
+            put,
             args[0].cast<std::string>(),
-            isDataJson ? common::pythonDictToJson(args[1].cast<pybind11::dict>()) : PyUnicode_AsUTF8(args[1].ptr()),
+            isDataJson ? common::pythonDictToJson(args[1].cast<pybind11::dict>()) : std::string(PyUnicode_AsUTF8(args[1].ptr())),
             isDataJson,
             3 <= args.size() ? common::pythonDictToMap(args[2].cast<pybind11::dict>()) : std::unordered_map<std::string, std::string>{},
             4 <= args.size() ? args[3].cast<std::string>() : "",
@@ -320,7 +413,8 @@ namespace ModuleRequests::Bindings
         if (1 < args.size() && !PyDict_Check(args[1].ptr()))
             throw std::runtime_error("requests.delete(...){...} ==> the 2 parameter \"headers\" must a dict");
 
-        auto response = delete_(
+        auto response = common::pythonWithoutGil(
+            delete_,
             args[0].cast<std::string>(),
             2 <= args.size() ? common::pythonDictToMap(args[1].cast<pybind11::dict>()) : std::unordered_map<std::string, std::string>{},
             3 <= args.size() ? args[2].cast<std::string>() : "",
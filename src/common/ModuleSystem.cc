@@ -6,7 +6,7 @@ namespace ModuleSystem
     {
         luabridge::getGlobalNamespace(luaState)
             .beginNamespace("system")
-            .addFunction("delay", delay)
+            .addFunction("delay", luaDelay)
             .endNamespace();
     }
 
@@ -15,7 +15,7 @@ namespace ModuleSystem
         auto module = pybind11::cast<pybind11::module>(mainModule);
 
         auto systemModule = module.def_submodule("system");
-        systemModule.def("delay", delay);
+        systemModule.def("delay", delay, pybind11::call_guard<pybind11::gil_scoped_release>());
     }
 
     void bind(JSContext *context)
@@ -29,6 +29,34 @@ namespace ModuleSystem
 
     void delay(size_t milliseconds)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+        ThreadPool::BlockingScope blocking;
+
+        TaskControl::sleep(std::chrono::milliseconds(milliseconds));
+    }
+
+    int luaDelay(lua_State *luaState)
+    {
+        auto milliseconds = static_cast<size_t>(std::max<lua_Number>(0, luaL_checknumber(luaState, 1)));
+        if (!LuaCoroutine::suspendable(luaState))
+        {
+            delay(milliseconds);
+
+            return 0;
+        }
+
+        return LuaCoroutine::suspend(
+            luaState,
+            [milliseconds](const LuaCoroutine::complete_t &complete)
+            {
+                auto timer = g_eventLoop.after(
+                    std::chrono::milliseconds(milliseconds),
+                    [complete]
+                    {
+                        complete([](lua_State *) { return 0; });
+                    });
+
+                return std::function<void()>([timer]
+                                             { g_eventLoop.cancel(timer); });
+            });
     }
 }
\ No newline at end of file
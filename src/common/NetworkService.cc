@@ -3,8 +3,7 @@
 using self = NetworkService;
 
 self::NetworkService(const char *host, uint16_t port)
-    : m_service({host, port}),
-      m_eventHandlers()
+    : m_service({host, port})
 {
     m_service.set_option(yasio::inet::YOPT_C_UNPACK_PARAMS, 10 * 1024 * 1024, -1, 4, 0);
     m_service.set_option(yasio::inet::YOPT_S_NO_DISPATCH, 0);
@@ -18,14 +17,34 @@ self::NetworkService(const char *host, uint16_t port)
             case yasio::YEK_ON_OPEN:
                 break;
             case yasio::YEK_ON_CLOSE:
-                if (m_clientInfos.contains(ev->source_id()))
-                    m_clientInfos.erase(ev->source_id());
+                if (m_clientInfos.load()->contains(ev->source_id()))
+                    m_clientInfos.update([transportId = ev->source_id()](auto &clients)
+                                         { clients.erase(transportId); });
                 break;
             case yasio::YEK_ON_PACKET:
                 if (!isNormalPacket(ev))
                     break; // not a normal packet, ignore it
 
-                g_threadPool.addRunable(&NetworkService::dataHandler, this, ev->source_id(), ev->transport(), ev->packet());
+                // compressed packets share one stream, so they are inflated here in the order they arrived
+                if (!inflatePacket(ev->source_id(), ev->packet()))
+                {
+                    m_service.close(ev->transport());
+                    break;
+                }
+
+                g_threadPool.submit(
+                    [this, transportId = ev->source_id(), transportHandle = ev->transport(), packet = std::move(ev->packet())]() mutable
+                    {
+                        // reading past the end of a truncated or malformed packet throws, the client is dropped for it
+                        try
+                        {
+                            dataHandler(transportId, transportHandle, packet);
+                        }
+                        catch (const std::exception &)
+                        {
+                            m_service.close(transportHandle);
+                        }
+                    });
                 break;
             };
         });
@@ -37,22 +56,125 @@ self::~NetworkService()
     m_service.close(0);
 }
 
-int self::backward(uint32_t clientId, yasio::packet_t &&packet)
+int self::backward(uint32_t clientId, yasio::packet_t &&packet, uint32_t requestId)
 {
-    if (!m_clientInfos.contains(clientId))
-        return -1;
+    if (nullptr != m_redirect)
+        return m_redirect(std::move(packet));
 
-    auto &client = m_clientInfos[clientId];
-    if (!client.handshaked)
+    // the snapshot keeps the entry alive even if the client disconnects meanwhile
+    auto clients = m_clientInfos.load();
+    auto it = clients->find(clientId);
+    if (clients->end() == it || !it->second.handshaked)
         return -1;
 
-    return m_service.write(client.transportHandle, packet);
+    // size, command, request id, then the body of the packet compressed
+    if (nullptr != it->second.compression && 5 <= packet.size() && g_compressionThreshold <= packet.size() - 5)
+    {
+        auto &client = it->second;
+
+        return client.compression->compress(
+            {reinterpret_cast<const char *>(packet.data()) + 5, packet.size() - 5},
+            [&](std::string_view compressed)
+            {
+                yasio::obstream obs;
+                auto packetSize = obs.push<uint32_t>();
+                obs.write_byte(static_cast<uint8_t>(static_cast<uint8_t>(packet[4]) | compressedFlag));
+                if (1 < client.revision)
+                    obs.write<uint32_t>(requestId);
+                obs.write_bytes(compressed.data(), static_cast<int>(compressed.size()));
+                obs.pop<uint32_t>(packetSize);
+
+                return m_service.write(client.transportHandle, std::move(obs.buffer()));
+            });
+    }
+
+    // size, command, request id, then the body of the packet
+    if (1 < it->second.revision && 5 <= packet.size())
+    {
+        yasio::obstream obs;
+        auto packetSize = obs.push<uint32_t>();
+        obs.write_bytes(packet.data() + 4, 1);
+        obs.write<uint32_t>(requestId);
+        obs.write_bytes(packet.data() + 5, static_cast<int>(packet.size() - 5));
+        obs.pop<uint32_t>(packetSize);
+
+        return m_service.write(it->second.transportHandle, std::move(obs.buffer()));
+    }
+
+    return m_service.write(it->second.transportHandle, packet);
+}
+
+uint8_t self::revision(uint32_t clientId)
+{
+    if (nullptr != m_redirect)
+        return 0;
+
+    auto clients = m_clientInfos.load();
+    auto it = clients->find(clientId);
+    if (clients->end() == it || !it->second.handshaked)
+        return 0;
+
+    return it->second.revision;
+}
+
+uint64_t self::addListener(listeners_t &listeners, command_t command, event_callback_t &&callback)
+{
+    auto listenerId = m_nextListenerId.fetch_add(1, std::memory_order_relaxed);
+
+    listeners[static_cast<size_t>(command)].update([&](auto &commandListeners)
+                                                   { commandListeners.push_back({listenerId, std::move(callback)}); });
+
+    return listenerId;
+}
+
+void self::removeListener(listeners_t &listeners, command_t command, uint64_t listenerId)
+{
+    listeners[static_cast<size_t>(command)].update(
+        [listenerId](auto &commandListeners)
+        {
+            std::erase_if(commandListeners, [listenerId](const Listener &listener)
+                          { return listenerId == listener.id; });
+        });
+}
+
+bool self::inflatePacket(uint32_t transportId, yasio::packet_t &packet)
+{
+    // bounds what a small crafted packet may inflate to
+    constexpr size_t inflateLimit = 64 * 1024 * 1024;
+
+    if (5 > packet.size() || 0 == (static_cast<uint8_t>(packet[4]) & compressedFlag))
+        return true;
+
+    auto clients = m_clientInfos.load();
+    auto it = clients->find(transportId);
+    if (clients->end() == it || nullptr == it->second.compression)
+        return false;
+
+    auto headerSize = 1 < it->second.revision ? size_t(9) : size_t(5);
+    if (headerSize > packet.size())
+        return false;
+
+    std::string body;
+    if (!it->second.compression->decompress({reinterpret_cast<const char *>(packet.data()) + headerSize, packet.size() - headerSize}, body, inflateLimit))
+        return false;
+
+    yasio::obstream obs;
+    auto packetSize = obs.push<uint32_t>();
+    obs.write_byte(static_cast<uint8_t>(static_cast<uint8_t>(packet[4]) & ~compressedFlag));
+    obs.write_bytes(reinterpret_cast<const char *>(packet.data()) + 5, static_cast<int>(headerSize - 5));
+    obs.write_bytes(body.data(), static_cast<int>(body.size()));
+    obs.pop<uint32_t>(packetSize);
+
+    packet = std::move(obs.buffer());
+
+    return true;
 }
 
 bool self::isNormalPacket(const yasio::event_ptr &ev)
 {
-    if (m_clientInfos.contains(ev->source_id()))
-        return m_clientInfos[ev->source_id()].handshaked; // permit only handshaked clients
+    auto clients = m_clientInfos.load();
+    if (auto it = clients->find(ev->source_id()); clients->end() != it)
+        return it->second.handshaked; // permit only handshaked clients
 
     if (5 > ev->packet().size())
         return false; // too short
@@ -88,10 +210,25 @@ void self::dataHandler(uint32_t transportId, yasio::transport_handle_t transport
 
         if (g_serviceKey == ibs.read_v32())
         {
-            m_clientInfos[transportId].handshaked = true;
-            m_clientInfos[transportId].transportHandle = transportHandle;
+            // clients of revision 1 send the key only and get no revision back, the same goes for the capabilities
+            auto hasRevision = static_cast<size_t>(ibs.tell()) < ibs.length();
+            auto revision = hasRevision ? std::clamp<uint8_t>(ibs.read<uint8_t>(), 1, protocolRevision) : uint8_t(1);
+            auto hasCapabilities = hasRevision && static_cast<size_t>(ibs.tell()) < ibs.length();
+            auto agreed = hasCapabilities ? static_cast<uint8_t>(ibs.read<uint8_t>() & capabilities) : uint8_t(0);
+
+            // a new handshake starts new streams
+            std::shared_ptr<Compression> compression;
+            if (0 != (agreed & static_cast<uint8_t>(Capability::compression)))
+                compression = std::make_shared<Compression>();
+
+            m_clientInfos.update([transportId, transportHandle, revision, agreed, &compression](auto &clients)
+                                 { clients[transportId] = {true, transportHandle, revision, agreed, std::move(compression)}; });
 
             obs.write_byte(true);
+            if (hasRevision)
+                obs.write_byte(revision);
+            if (hasCapabilities)
+                obs.write_byte(agreed);
         }
         else
             obs.write_byte(false);
@@ -103,25 +240,41 @@ void self::dataHandler(uint32_t transportId, yasio::transport_handle_t transport
     }
 
     // check if the client is not handshaked
-    if (!m_clientInfos.contains(transportId) || !m_clientInfos[transportId].handshaked)
-        return;
-
-    // event callback
-    for (auto it = m_eventCallbacks.equal_range(command); it.first != it.second; it.first++)
+    uint32_t requestId = 0;
     {
-        ibs.seek(5, SEEK_SET);
-        it.first->second(transportId, ibs);
+        auto clients = m_clientInfos.load();
+        auto it = clients->find(transportId);
+        if (clients->end() == it || !it->second.handshaked)
+            return;
+
+        if (1 < it->second.revision)
+        {
+            if (9 > packet.size())
+                return;
+
+            requestId = ibs.read<uint32_t>();
+        }
     }
-    {
-        std::unique_lock<std::mutex> locker(m_mutex);
+    auto bodyOffset = ibs.tell();
+
+    auto index = static_cast<size_t>(command);
 
-        m_eventCallbacks.erase(command);
+    // event callback, taken at once so that each runs for one packet only
+    if (!m_eventCallbacks[index].load()->empty())
+    {
+        auto callbacks = m_eventCallbacks[index].take();
+        for (auto &callback : *callbacks)
+        {
+            ibs.seek(bodyOffset, SEEK_SET);
+            callback.callback(transportId, requestId, ibs);
+        }
     }
 
-    // event handler
-    for (auto it = m_eventHandlers.equal_range(command); it.first != it.second; it.first++)
+    // event handler, added and removed handlers take effect from the next packet
+    auto handlers = m_eventHandlers[index].load();
+    for (auto &handler : *handlers)
     {
-        ibs.seek(5, SEEK_SET);
-        it.first->second(transportId, ibs);
+        ibs.seek(bodyOffset, SEEK_SET);
+        handler.callback(transportId, requestId, ibs);
     }
 }
\ No newline at end of file
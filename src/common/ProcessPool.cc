@@ -0,0 +1,414 @@
+#include "ProcessPool.h"
+
+#if defined(__linux__)
+#include <poll.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+using self = ProcessPool;
+
+#if defined(__linux__)
+
+namespace
+{
+    bool sendAll(int channel, const char *data, size_t size)
+    {
+        while (0 < size)
+        {
+            // a killed peer must not raise SIGPIPE here
+            auto sent = ::send(channel, data, size, MSG_NOSIGNAL);
+            if (0 > sent && EINTR == errno)
+                continue;
+            if (0 >= sent)
+                return false;
+
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+
+        return true;
+    }
+
+    bool receiveAll(int channel, char *data, size_t size)
+    {
+        while (0 < size)
+        {
+            auto received = ::recv(channel, data, size, 0);
+            if (0 > received && EINTR == errno)
+                continue;
+            if (0 >= received)
+                return false;
+
+            data += received;
+            size -= static_cast<size_t>(received);
+        }
+
+        return true;
+    }
+
+    // the pid of a new worker and the core's end of its channel, pid -1 if the fork failed
+    bool sendWorker(int socket, int pid, int channel)
+    {
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        iovec data{&pid, sizeof(pid)};
+        msghdr message{};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+
+        if (-1 != channel)
+        {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            auto header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &channel, sizeof(int));
+        }
+
+        return sizeof(pid) == ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    }
+
+    bool receiveWorker(int socket, int &pid, int &channel)
+    {
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        iovec data{&pid, sizeof(pid)};
+        msghdr message{};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do
+            received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+        while (0 > received && EINTR == errno);
+        if (sizeof(pid) != received || -1 == pid)
+            return false;
+
+        auto header = CMSG_FIRSTHDR(&message);
+        if (nullptr == header || SCM_RIGHTS != header->cmsg_type)
+            return false;
+        std::memcpy(&channel, CMSG_DATA(header), sizeof(int));
+
+        return true;
+    }
+
+    // whatever the core had open, e.g. the listening socket of the service, stays with the core
+    void closeInherited(int keep)
+    {
+        std::vector<int> descriptors;
+
+        std::error_code error;
+        for (auto &entry : std::filesystem::directory_iterator("/proc/self/fd", error))
+        {
+            auto descriptor = std::atoi(entry.path().filename().c_str());
+            if (STDERR_FILENO < descriptor && keep != descriptor)
+                descriptors.push_back(descriptor);
+        }
+
+        for (auto descriptor : descriptors)
+            ::close(descriptor);
+    }
+}
+
+bool self::Lease::send(std::string_view frame)
+{
+    if (!write(m_worker.channel, frame))
+        m_broken = true;
+
+    return !m_broken;
+}
+
+self::Receive self::Lease::receive(std::string &frame, std::chrono::milliseconds timeout)
+{
+    pollfd descriptor{m_worker.channel, POLLIN, 0};
+    if (0 >= ::poll(&descriptor, 1, static_cast<int>(timeout.count())))
+        return Receive::timeout;
+
+    if (read(m_worker.channel, frame))
+        return Receive::frame;
+
+    m_broken = true;
+
+    return Receive::closed;
+}
+
+void self::Lease::kill()
+{
+    // the zygote reaps its workers only before it forks the next one, so the pid cannot be reused yet
+    ::kill(m_worker.pid, SIGKILL);
+    m_killed = true;
+}
+
+self::~ProcessPool()
+{
+    if (!started())
+        return;
+
+    // the zygote and idle workers exit once their channel is closed
+    for (auto &worker : m_idle)
+        ::close(worker.channel);
+    ::close(m_zygote);
+}
+
+bool self::start(size_t workers, prepare_t &&prepare, serve_t &&serve)
+{
+    int channels[2];
+    if (0 != ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channels))
+        return false;
+
+    auto core = ::getpid();
+    auto pid = ::fork();
+    if (0 == pid)
+    {
+        ::close(channels[0]);
+
+        // die with the core, the workers die with the zygote
+        ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (core != ::getppid())
+            ::_exit(0);
+
+        zygote(channels[1], prepare, serve);
+    }
+    ::close(channels[1]);
+    if (-1 == pid)
+    {
+        ::close(channels[0]);
+
+        return false;
+    }
+    m_zygote = channels[0];
+
+    std::unique_lock<std::mutex> zygoteLocker(m_zygoteMutex);
+    for (size_t i = 0; i < workers; i++)
+    {
+        auto worker = spawn();
+        if (-1 == worker.pid)
+            break;
+
+        std::unique_lock<std::mutex> locker(m_mutex);
+        m_idle.push_back(worker);
+        m_size++;
+    }
+
+    if (0 == m_size)
+    {
+        ::close(m_zygote);
+        m_zygote = -1;
+    }
+
+    return started();
+}
+
+self::Lease self::acquire()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    m_condition.wait(locker, [this]
+                     { return !m_idle.empty() || 0 == m_size; });
+    if (m_idle.empty())
+        return {};
+
+    auto worker = m_idle.back();
+    m_idle.pop_back();
+
+    return {this, worker};
+}
+
+bool self::reply(std::string_view frame)
+{
+    return write(s_channel, frame);
+}
+
+size_t self::size()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    return m_size;
+}
+
+size_t self::idle()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    return m_idle.size();
+}
+
+void self::release(Worker worker, bool broken)
+{
+    if (broken)
+    {
+        ::kill(worker.pid, SIGKILL);
+        ::close(worker.channel);
+
+        std::unique_lock<std::mutex> zygoteLocker(m_zygoteMutex);
+
+        worker = spawn();
+        if (-1 == worker.pid)
+        {
+            {
+                std::unique_lock<std::mutex> locker(m_mutex);
+
+                m_size--;
+            }
+            // waiters give up once no worker is left
+            m_condition.notify_all();
+
+            return;
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        m_idle.push_back(worker);
+    }
+    m_condition.notify_one();
+}
+
+self::Worker self::spawn()
+{
+    Worker worker;
+
+    char command = 0;
+    if (!sendAll(m_zygote, &command, 1) || !receiveWorker(m_zygote, worker.pid, worker.channel))
+        return {};
+
+    return worker;
+}
+
+void self::zygote(int channel, const prepare_t &prepare, const serve_t &serve)
+{
+    closeInherited(channel);
+
+    prepare();
+
+    auto zygotePid = ::getpid();
+    for (;;)
+    {
+        char command;
+        if (!receiveAll(channel, &command, 1))
+            ::_exit(0);
+
+        // killed workers are reaped only now, until then their pids stay taken
+        while (0 < ::waitpid(-1, nullptr, WNOHANG))
+            ;
+
+        int channels[2];
+        if (0 != ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channels))
+        {
+            sendWorker(channel, -1, -1);
+            continue;
+        }
+
+        auto pid = ::fork();
+        if (0 == pid)
+        {
+            ::close(channel);
+            ::close(channels[0]);
+
+            ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (zygotePid != ::getppid())
+                ::_exit(0);
+
+            worker(channels[1], serve);
+        }
+
+        sendWorker(channel, pid, -1 == pid ? -1 : channels[0]);
+        ::close(channels[0]);
+        ::close(channels[1]);
+    }
+}
+
+void self::worker(int channel, const serve_t &serve)
+{
+    s_channel = channel;
+
+    std::string request;
+    while (read(channel, request))
+        serve(std::move(request));
+
+    // the state copied from the core, e.g. its thread pool, must not be torn down here
+    ::_exit(0);
+}
+
+bool self::write(int channel, std::string_view frame)
+{
+    auto size = static_cast<uint32_t>(frame.size());
+
+    return sendAll(channel, reinterpret_cast<const char *>(&size), sizeof(size)) && sendAll(channel, frame.data(), frame.size());
+}
+
+bool self::read(int channel, std::string &frame)
+{
+    uint32_t size;
+    if (!receiveAll(channel, reinterpret_cast<char *>(&size), sizeof(size)))
+        return false;
+
+    frame.resize(size);
+
+    return receiveAll(channel, frame.data(), size);
+}
+
+#else
+
+bool self::Lease::send(std::string_view frame)
+{
+    return false;
+}
+
+self::Receive self::Lease::receive(std::string &frame, std::chrono::milliseconds timeout)
+{
+    return Receive::closed;
+}
+
+void self::Lease::kill()
+{
+}
+
+self::~ProcessPool()
+{
+}
+
+bool self::start(size_t workers, prepare_t &&prepare, serve_t &&serve)
+{
+    // fork(...) is not available, tasks keep running in the core process
+    return false;
+}
+
+self::Lease self::acquire()
+{
+    return {};
+}
+
+bool self::reply(std::string_view frame)
+{
+    return false;
+}
+
+size_t self::size()
+{
+    return 0;
+}
+
+size_t self::idle()
+{
+    return 0;
+}
+
+void self::release(Worker worker, bool broken)
+{
+}
+
+#endif
\ No newline at end of file
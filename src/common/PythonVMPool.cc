@@ -0,0 +1,456 @@
+#include "PythonVMPool.h"
+#include "global.h"
+#include "Metrics.h"
+#include "ModuleCrypto.h"
+#include "ModuleJson.h"
+#include "ModuleRequests.h"
+#include "ModuleTools.h"
+#include "ModuleSystem.h"
+
+#include <marshal.h>
+
+#include <algorithm>
+#include <chrono>
+
+using self = PythonVMPool;
+
+namespace
+{
+    struct PoolMetrics
+    {
+        Metrics::counter_t &created = Metrics::counter("pypool.created");
+        Metrics::counter_t &reused = Metrics::counter("pypool.reused");
+        // total microseconds spent creating interpreters
+        Metrics::counter_t &creationTime = Metrics::counter("pypool.creation_us");
+        // estimated microseconds saved by reuse, reuses times the average creation time
+        Metrics::counter_t &savedTime = Metrics::counter("pypool.saved_us");
+        // total microseconds spent binding modules, eagerly on creation or lazily on first access
+        Metrics::counter_t &bindTime = Metrics::counter("pypool.bind_us");
+    };
+
+    PoolMetrics &metrics()
+    {
+        static PoolMetrics instance;
+
+        return instance;
+    }
+
+    struct LazyModule
+    {
+        const char *name;
+        void (*bind)(PyObject *mainModule);
+    };
+
+    const LazyModule lazyModules[] = {
+        {"crypto", ModuleCrypto::bind},
+        {"json", ModuleJson::bind},
+        {"requests", ModuleRequests::bind},
+        {"system", ModuleSystem::bind},
+    };
+
+    // the snapshot is also kept in the interpreter dict, so that lazily bound modules can join it
+    constexpr auto snapshotKey = "PythonVMPool.snapshot";
+
+    size_t sizeOf(PyObject *object)
+    {
+        // the __sizeof__ of a class of the task would run its code, it is charged the basic size only
+        if (PyType_HasFeature(Py_TYPE(object), Py_TPFLAGS_HEAPTYPE))
+            return static_cast<size_t>(Py_TYPE(object)->tp_basicsize);
+
+        auto size = _PySys_GetSizeOf(object);
+        if (static_cast<size_t>(-1) == size)
+        {
+            PyErr_Clear();
+            return 0;
+        }
+
+        return size;
+    }
+
+    // estimated bytes of the objects of the current interpreter, the gc tracked ones and the untracked ones they refer to
+    size_t heapSize()
+    {
+        auto gc = PyImport_ImportModule("gc");
+        auto objects = nullptr == gc ? nullptr : PyObject_CallMethod(gc, "get_objects", nullptr);
+        Py_XDECREF(gc);
+        if (nullptr == objects)
+        {
+            PyErr_Clear();
+            return 0;
+        }
+
+        size_t size = 0;
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(objects); i++)
+        {
+            auto object = PyList_GET_ITEM(objects, i);
+            size += sizeOf(object);
+
+            // strings, numbers and bytes are not tracked, an untracked object shared by several is counted by each
+            if (auto traverse = Py_TYPE(object)->tp_traverse; nullptr != traverse)
+                traverse(
+                    object,
+                    [](PyObject *referent, void *size)
+                    {
+                        if (!PyObject_GC_IsTracked(referent))
+                            *static_cast<size_t *>(size) += sizeOf(referent);
+
+                        return 0;
+                    },
+                    &size);
+        }
+        Py_DECREF(objects);
+
+        return size;
+    }
+}
+
+void self::initialize()
+{
+    // no signal handlers, interrupts are delivered by TaskControl
+    Py_InitializeEx(0);
+
+    // workers attach thread states of their own, the main thread keeps none
+    PyEval_SaveThread();
+}
+
+self::Lease self::acquire(void *loggerOptions, const StickyTicket *ticket)
+{
+    auto &pool = idle();
+    auto &counters = metrics();
+
+    std::unique_ptr<VM> vm;
+    if (nullptr != ticket)
+        vm = sticky().take(*ticket);
+
+    auto warm = nullptr != vm;
+    if (!warm)
+    {
+        std::unique_lock<std::mutex> locker(pool.mutex);
+
+        if (!pool.vms.empty())
+        {
+            vm = std::move(pool.vms.back());
+            pool.vms.pop_back();
+        }
+    }
+
+    PyThreadState *threadState = nullptr;
+    if (nullptr != vm)
+    {
+        threadState = PyThreadState_New(vm->interpreter);
+        PyEval_RestoreThread(threadState);
+
+        if (!warm)
+        {
+            counters.reused++;
+            if (auto created = counters.created.load(); 0 < created)
+                counters.savedTime += counters.creationTime.load() / created;
+        }
+    }
+    else
+    {
+        auto begin = std::chrono::steady_clock::now();
+        vm = create(threadState);
+        if (nullptr == vm)
+            return {nullptr, nullptr};
+
+        counters.created++;
+        counters.creationTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // the logger finds its task through this option
+    ModuleTools::bind(vm->mainModule, loggerOptions);
+
+    // the growth of the heap across the run is charged to the sticky cache if the task sticks. walking the heap is slow,
+    // a warm vm starts from what its last release measured and a reset one from its pristine heap
+    if (nullptr != ticket && !warm)
+    {
+        if (0 == vm->pristineHeapSize)
+            vm->pristineHeapSize = heapSize();
+        vm->leaseHeapSize = vm->pristineHeapSize;
+    }
+
+    return {std::move(vm), threadState, ticket, warm};
+}
+
+bool self::invalidate(uint64_t userId, uint64_t taskId)
+{
+    return sticky().invalidate(userId, taskId);
+}
+
+self::Idle &self::idle()
+{
+    static Idle instance;
+
+    return instance;
+}
+
+std::unique_ptr<self::VM> self::create(PyThreadState *&threadState)
+{
+#if defined(PYTHON_OWN_GIL)
+    // called without a thread state, the interpreter creates and takes a gil of its own.
+    // single-phase extension modules cannot be imported into it
+    PyInterpreterConfig config{
+        .use_main_obmalloc = 0,
+        .allow_fork = 0,
+        .allow_exec = 0,
+        .allow_threads = 1,
+        .allow_daemon_threads = 0,
+        .check_multi_interp_extensions = 1,
+        .gil = PyInterpreterConfig_OWN_GIL,
+    };
+    threadState = nullptr;
+    if (PyStatus_Exception(Py_NewInterpreterFromConfig(&threadState, &config)))
+        return nullptr;
+#else
+    // the shared gil is taken through a temporary thread state of the main interpreter
+    auto helper = PyThreadState_New(PyInterpreterState_Main());
+    PyEval_RestoreThread(helper);
+
+    auto creator = Py_NewInterpreter();
+    if (nullptr == creator)
+    {
+        PyThreadState_Swap(helper);
+        PyThreadState_Clear(helper);
+        PyThreadState_DeleteCurrent();
+
+        return nullptr;
+    }
+
+    // pybind11 finds the gil owner through PyGILState_GetThisThreadState(), which is the first thread state
+    // created on a thread. drop the helper first so that a thread state of the new interpreter takes that place
+    PyThreadState_Clear(helper);
+    PyThreadState_Delete(helper);
+
+    threadState = PyThreadState_New(PyThreadState_GetInterpreter(creator));
+    PyThreadState_Swap(threadState);
+#endif
+
+    auto vm = std::make_unique<VM>();
+    vm->interpreter = PyThreadState_GetInterpreter(threadState);
+#if !defined(PYTHON_OWN_GIL)
+    vm->keeper = creator;
+#endif
+
+    try
+    {
+        vm->mainModule = PyImport_AddModule("__main__");
+        if (nullptr == vm->mainModule)
+            throw pybind11::error_already_set();
+        Py_INCREF(vm->mainModule);
+
+        // register modules, the logger is bound again for every task anyway
+        auto begin = std::chrono::steady_clock::now();
+        ModuleTools::bind(vm->mainModule);
+        if (g_lazyModuleBinding)
+        {
+            // the other modules start empty and are filled by their module level __getattr__ (PEP 562)
+            auto module = pybind11::cast<pybind11::module>(vm->mainModule);
+            for (auto &lazyModule : lazyModules)
+                module.def_submodule(lazyModule.name).attr("__getattr__") = pybind11::cpp_function(
+                    [&lazyModule](const std::string &attribute)
+                    {
+                        return lazyAttribute(lazyModule.name, lazyModule.bind, attribute);
+                    });
+        }
+        else
+            for (auto &lazyModule : lazyModules)
+                lazyModule.bind(vm->mainModule);
+        metrics().bindTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        vm->snapshot = snapshot(vm->mainModule);
+        if (0 != PyDict_SetItemString(PyInterpreterState_GetDict(vm->interpreter), snapshotKey, vm->snapshot))
+            throw pybind11::error_already_set();
+        vm->codes = PyDict_New();
+        if (nullptr == vm->codes)
+            throw pybind11::error_already_set();
+    }
+    catch (const std::exception &)
+    {
+        // the half initialized interpreter is left behind
+        PyErr_Clear();
+        PyThreadState_Clear(threadState);
+        PyThreadState_DeleteCurrent();
+
+        return nullptr;
+    }
+
+    return vm;
+}
+
+PyObject *self::snapshot(PyObject *mainModule)
+{
+    auto snapshot = PyList_New(0);
+
+    auto record = [snapshot](PyObject *dict)
+    {
+        auto copy = PyDict_Copy(dict);
+        auto pair = PyTuple_Pack(2, dict, copy);
+        PyList_Append(snapshot, pair);
+        Py_DECREF(pair);
+        Py_DECREF(copy);
+    };
+
+    // `__main__` and the namespaces below it, i.e. the bound modules and builtins
+    auto globals = PyModule_GetDict(mainModule);
+    record(globals);
+
+    PyObject *key, *value;
+    Py_ssize_t position = 0;
+    while (PyDict_Next(globals, &position, &key, &value))
+        if (PyModule_Check(value))
+            record(PyModule_GetDict(value));
+
+    return snapshot;
+}
+
+pybind11::object self::lazyAttribute(const char *name, void (*bind)(PyObject *), const std::string &attribute)
+{
+    auto mainModule = pybind11::reinterpret_borrow<pybind11::module>(PyImport_AddModule("__main__"));
+    auto module = pybind11::reinterpret_borrow<pybind11::module>(PyImport_AddModule((std::string("__main__.") + name).c_str()));
+    auto dict = pybind11::reinterpret_borrow<pybind11::dict>(PyModule_GetDict(module.ptr()));
+
+    // probes of the import machinery and the like do not bind the module
+    if (!dict.contains("__getattr__") || 0 == attribute.rfind("__", 0))
+        throw pybind11::attribute_error("module '" + std::string(name) + "' has no attribute '" + attribute + "'");
+
+    PyDict_DelItemString(dict.ptr(), "__getattr__");
+    auto before = pybind11::reinterpret_steal<pybind11::dict>(PyDict_Copy(dict.ptr()));
+
+    auto begin = std::chrono::steady_clock::now();
+    bind(mainModule.ptr());
+    metrics().bindTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+
+    // the bound names become part of the pristine state, so they survive the reset after this task
+    auto snapshot = PyDict_GetItemString(PyInterpreterState_GetDict(PyInterpreterState_Get()), snapshotKey);
+    for (Py_ssize_t i = 0; nullptr != snapshot && i < PyList_GET_SIZE(snapshot); i++)
+    {
+        auto pair = PyList_GET_ITEM(snapshot, i);
+        if (PyTuple_GET_ITEM(pair, 0) != dict.ptr())
+            continue;
+
+        auto copy = PyTuple_GET_ITEM(pair, 1);
+        PyDict_DelItemString(copy, "__getattr__");
+        for (auto [key, value] : dict)
+            if (!before.contains(key) || before[key].ptr() != value.ptr())
+                PyDict_SetItem(copy, key.ptr(), value.ptr());
+    }
+    PyErr_Clear();
+
+    return module.attr(attribute.c_str());
+}
+
+PyObject *self::run(VM &vm, const std::string &script)
+{
+    // like .pyc files, marshalled code is only valid for the same magic number
+    auto key = g_pythonScriptCache.key(std::to_string(PyImport_GetMagicNumber()) + "\n" + script);
+    auto name = PyUnicode_FromStringAndSize(key.data(), key.size());
+    if (nullptr == name)
+        return nullptr;
+
+    auto code = PyDict_GetItemWithError(vm.codes, name);
+    Py_XINCREF(code);
+    if (nullptr == code && !PyErr_Occurred())
+    {
+        if (auto compiled = g_pythonScriptCache.find(key); nullptr != compiled)
+        {
+            code = PyMarshal_ReadObjectFromString(compiled->data(), compiled->size());
+            if (nullptr == code || !PyCode_Check(code))
+            {
+                Py_CLEAR(code);
+                PyErr_Clear();
+            }
+        }
+
+        if (nullptr == code)
+        {
+            code = Py_CompileString(script.c_str(), "<string>", Py_file_input);
+            if (nullptr != code)
+            {
+                if (auto data = PyMarshal_WriteObjectToString(code, Py_MARSHAL_VERSION); nullptr != data)
+                {
+                    g_pythonScriptCache.insert(key, std::string(PyBytes_AS_STRING(data), PyBytes_GET_SIZE(data)));
+                    Py_DECREF(data);
+                }
+                else
+                    PyErr_Clear();
+            }
+        }
+
+        if (nullptr != code)
+        {
+            if (maxCodes <= PyDict_GET_SIZE(vm.codes))
+                PyDict_Clear(vm.codes);
+            if (0 != PyDict_SetItem(vm.codes, name, code))
+                PyErr_Clear();
+        }
+    }
+    Py_DECREF(name);
+
+    if (nullptr == code)
+        return nullptr;
+
+    auto globals = PyModule_GetDict(vm.mainModule);
+    auto result = PyEval_EvalCode(code, globals, globals);
+    Py_DECREF(code);
+
+    return result;
+}
+
+StickyCache<self::VM> &self::sticky()
+{
+    // interpreters are never ended, a dropped warm one is reset and goes back to the pool
+    static StickyCache<VM> instance("pysticky", g_stickyMemoryLimit, g_stickyMaxVMs, [](std::unique_ptr<VM> &&vm)
+                                    {
+                                        auto threadState = PyThreadState_New(vm->interpreter);
+                                        PyEval_RestoreThread(threadState);
+                                        release(std::move(vm), threadState, nullptr); });
+
+    return instance;
+}
+
+void self::release(std::unique_ptr<VM> &&vm, PyThreadState *threadState, const StickyTicket *ticket)
+{
+    if (nullptr != ticket)
+    {
+        // nothing is reset, the next run of the task continues with this state
+        PyErr_Clear();
+
+        // what this run added or freed, on top of what the earlier runs of the task added
+        auto heap = heapSize();
+        if (heap >= vm->leaseHeapSize)
+            vm->stickySize += heap - vm->leaseHeapSize;
+        else
+            vm->stickySize -= std::min(vm->stickySize, vm->leaseHeapSize - heap);
+        auto size = vm->stickySize;
+        vm->leaseHeapSize = heap;
+
+        PyThreadState_Clear(threadState);
+        PyThreadState_DeleteCurrent();
+
+        sticky().put(*ticket, std::move(vm), size);
+
+        return;
+    }
+
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(vm->snapshot); i++)
+    {
+        auto pair = PyList_GET_ITEM(vm->snapshot, i);
+        auto dict = PyTuple_GET_ITEM(pair, 0);
+
+        PyDict_Clear(dict);
+        PyDict_Update(dict, PyTuple_GET_ITEM(pair, 1));
+    }
+    PyErr_Clear();
+    PyGC_Collect();
+    vm->stickySize = 0;
+
+    // detach this thread, the interpreter stays alive in the pool
+    PyThreadState_Clear(threadState);
+    PyThreadState_DeleteCurrent();
+
+    auto &pool = idle();
+    std::unique_lock<std::mutex> locker(pool.mutex);
+
+    pool.vms.push_back(std::move(vm));
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include "Scheduler.h"
+#include "Finally.h"
+
+#include <algorithm>
+
+using self = Scheduler;
+
+self::Scheduler(ThreadPool &threadPool, size_t maxInflight, size_t userConcurrency, uint32_t quantum)
+    : m_threadPool(threadPool),
+      m_maxInflight(std::max<size_t>(1, maxInflight)),
+      m_userConcurrency(std::max<size_t>(1, userConcurrency)),
+      m_quantum(std::max<uint32_t>(1, quantum))
+{
+}
+
+self::~Scheduler()
+{
+    while (nullptr != m_freeRunning)
+    {
+        auto running = m_freeRunning;
+        m_freeRunning = running->next;
+        delete running;
+    }
+}
+
+void self::submit(uint64_t userId, int32_t priority, ThreadPool::Task &&task)
+{
+    std::vector<ThreadPool::Task> ready;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        enqueue(userId, priority, std::move(task));
+        dispatch(ready);
+    }
+
+    launch(ready);
+}
+
+void self::submit(std::vector<Submission> &&submissions)
+{
+    std::vector<ThreadPool::Task> ready;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        for (auto &submission : submissions)
+            enqueue(submission.userId, submission.priority, std::move(submission.task));
+
+        dispatch(ready);
+    }
+
+    launch(ready);
+}
+
+std::optional<self::Context> self::current()
+{
+    if (nullptr == t_context)
+        return std::nullopt;
+
+    return *t_context;
+}
+
+void self::resume(const Context &context, ThreadPool::Task &&task)
+{
+    context.scheduler->submit(context.userId, context.priority, std::move(task));
+}
+
+void self::setWeight(uint64_t userId, uint32_t weight)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    if (1 >= weight)
+        m_weights.erase(userId);
+    else
+        m_weights[userId] = weight;
+}
+
+void self::setUserConcurrency(size_t userConcurrency)
+{
+    std::vector<ThreadPool::Task> ready;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        m_userConcurrency = std::max<size_t>(1, userConcurrency);
+        dispatch(ready);
+    }
+
+    launch(ready);
+}
+
+size_t self::pending()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    return m_pending;
+}
+
+size_t self::inflight()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    return m_inflight;
+}
+
+bool self::jobLess(const Job &left, const Job &right)
+{
+    if (left.priority != right.priority)
+        return left.priority < right.priority;
+
+    return left.sequence > right.sequence;
+}
+
+void self::enqueue(uint64_t userId, int32_t priority, ThreadPool::Task &&task)
+{
+    auto &user = m_users[userId];
+    user.jobs.push_back({priority, m_sequence++, std::move(task)});
+    std::push_heap(user.jobs.begin(), user.jobs.end(), &self::jobLess);
+    m_pending++;
+
+    if (!user.active)
+    {
+        user.active = true;
+        m_activeUsers.push_back(userId);
+    }
+}
+
+void self::run(Running *running)
+{
+    auto previous = t_context;
+    t_context = &running->context;
+    finally
+    {
+        t_context = previous;
+        running->context.scheduler->complete(running);
+    };
+
+    running->task();
+}
+
+void self::complete(Running *running)
+{
+    // the captures of the job are released outside the lock, their destructors may submit jobs
+    running->task = ThreadPool::Task();
+
+    std::vector<ThreadPool::Task> ready;
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        auto userId = running->context.userId;
+        running->next = m_freeRunning;
+        m_freeRunning = running;
+
+        auto &user = m_users[userId];
+        user.inflight--;
+        m_inflight--;
+
+        if (!user.active && 0 == user.inflight)
+            m_users.erase(userId);
+
+        dispatch(ready);
+    }
+
+    launch(ready);
+}
+
+void self::dispatch(std::vector<ThreadPool::Task> &ready)
+{
+    // every user at the front is either served or rotated, stop after a full pass without progress
+    size_t skipped = 0;
+
+    while (m_inflight < m_maxInflight && skipped < m_activeUsers.size())
+    {
+        auto userId = m_activeUsers.front();
+        auto &user = m_users[userId];
+
+        if (user.inflight >= m_userConcurrency)
+        {
+            m_activeUsers.pop_front();
+            m_activeUsers.push_back(userId);
+            skipped++;
+            continue;
+        }
+
+        // start a new round for this user
+        if (0 >= user.deficit)
+        {
+            auto weight = m_weights.find(userId);
+            user.deficit += static_cast<int64_t>(m_quantum) * (m_weights.end() == weight ? 1 : weight->second);
+        }
+
+        // the slot is freed when the job returns, also when it returns because it suspended
+        auto running = m_freeRunning;
+        if (nullptr == running)
+            running = new Running();
+        else
+            m_freeRunning = running->next;
+
+        std::pop_heap(user.jobs.begin(), user.jobs.end(), &self::jobLess);
+        running->context = {this, userId, user.jobs.back().priority};
+        running->task = std::move(user.jobs.back().task);
+        user.jobs.pop_back();
+
+        user.deficit--;
+        user.inflight++;
+        m_pending--;
+        m_inflight++;
+        skipped = 0;
+
+        ready.emplace_back([running]
+                           { run(running); });
+
+        if (user.jobs.empty())
+        {
+            m_activeUsers.pop_front();
+            user.active = false;
+            user.deficit = 0;
+        }
+        else if (0 >= user.deficit)
+        {
+            m_activeUsers.pop_front();
+            m_activeUsers.push_back(userId);
+        }
+    }
+}
+
+void self::launch(std::vector<ThreadPool::Task> &ready)
+{
+    for (auto &task : ready)
+        m_threadPool.submit(std::move(task));
+}
\ No newline at end of file
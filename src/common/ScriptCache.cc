@@ -0,0 +1,208 @@
+#include "ScriptCache.h"
+#include "ModuleCrypto.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+using self = ScriptCache;
+
+self::ScriptCache(const std::string &name, size_t capacity, const std::string &salt, const std::filesystem::path &directory)
+    : m_capacity(capacity),
+      m_salt(name + '\0' + salt + '\0'),
+      m_hits(Metrics::counter(name + ".hits")),
+      m_misses(Metrics::counter(name + ".misses"))
+{
+    setDirectory(directory);
+}
+
+std::string self::key(const std::string &source) const
+{
+    return ModuleCrypto::sha256(m_salt + source);
+}
+
+self::blob_t self::find(const std::string &key)
+{
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (auto entry = m_index.find(key); m_index.end() != entry)
+        {
+            // move to the front, the back is evicted first
+            m_entries.splice(m_entries.begin(), m_entries, entry->second);
+            m_hits++;
+
+            return entry->second->blob;
+        }
+    }
+
+    auto blob = load(key);
+    if (nullptr == blob)
+    {
+        m_misses++;
+        return nullptr;
+    }
+
+    std::lock_guard lock(m_mutex);
+    emplace(key, blob_t(blob));
+    m_hits++;
+
+    return blob;
+}
+
+void self::insert(const std::string &key, std::string &&compiled)
+{
+    auto blob = std::make_shared<const std::string>(std::move(compiled));
+
+    store(key, *blob);
+
+    std::lock_guard lock(m_mutex);
+    emplace(key, std::move(blob));
+}
+
+void self::erase(const std::string &key)
+{
+    std::filesystem::path path;
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (auto entry = m_index.find(key); m_index.end() != entry)
+        {
+            m_size -= entry->second->blob->size();
+            m_entries.erase(entry->second);
+            m_index.erase(entry);
+        }
+
+        if (m_directory.empty())
+            return;
+        path = m_directory / key;
+    }
+
+    std::error_code error;
+    std::filesystem::remove(path, error);
+}
+
+void self::clear()
+{
+    std::lock_guard lock(m_mutex);
+
+    m_entries.clear();
+    m_index.clear();
+    m_size = 0;
+}
+
+void self::setDirectory(const std::filesystem::path &directory)
+{
+    std::lock_guard lock(m_mutex);
+
+    m_directory = directory;
+    if (!m_directory.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+    }
+}
+
+size_t self::size()
+{
+    std::lock_guard lock(m_mutex);
+
+    return m_size;
+}
+
+self::blob_t self::load(const std::string &key)
+{
+    std::filesystem::path path;
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (m_directory.empty())
+            return nullptr;
+        path = m_directory / key;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return nullptr;
+
+    std::string compiled{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (file.bad())
+        return nullptr;
+    file.close();
+
+    // the hex sha256 of the blob comes first, truncated or damaged entries are deleted
+    constexpr size_t checksumSize = 64;
+    if (compiled.size() <= checksumSize || 0 != compiled.compare(0, checksumSize, ModuleCrypto::sha256(compiled.substr(checksumSize))))
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+
+        return nullptr;
+    }
+    compiled.erase(0, checksumSize);
+
+    return std::make_shared<const std::string>(std::move(compiled));
+}
+
+void self::store(const std::string &key, const std::string &compiled)
+{
+    std::filesystem::path path;
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (m_directory.empty())
+            return;
+        path = m_directory / key;
+    }
+
+    // write to a private file first, so readers never see a partial entry. cores sharing the directory may run threads
+    // with equal ids, the process id keeps their files apart
+    auto temporary = path;
+    temporary += '.' + std::to_string(getpid()) + '.' + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        auto checksum = ModuleCrypto::sha256(compiled);
+
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.write(checksum.data(), checksum.size()) || !file.write(compiled.data(), compiled.size()))
+            return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+        std::filesystem::remove(temporary, error);
+}
+
+void self::emplace(const std::string &key, blob_t &&blob)
+{
+    if (auto entry = m_index.find(key); m_index.end() != entry)
+    {
+        m_size -= entry->second->blob->size();
+        m_entries.erase(entry->second);
+        m_index.erase(entry);
+    }
+
+    // a single script larger than the whole cache is not kept in memory
+    if (blob->size() > m_capacity)
+        return;
+
+    m_size += blob->size();
+    m_entries.push_front({key, std::move(blob)});
+    m_index.emplace(key, m_entries.begin());
+
+    while (m_size > m_capacity)
+    {
+        auto &last = m_entries.back();
+
+        m_size -= last.blob->size();
+        m_index.erase(last.key);
+        m_entries.pop_back();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "TaskControl.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <thread>
+#include <unordered_set>
+
+namespace
+{
+    // polls tasks whose engine offers no hook, e.g. python
+    struct Watchdog
+    {
+        static constexpr auto interval = std::chrono::milliseconds(10);
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::unordered_set<TaskControl *> controls;
+        bool started = false;
+    };
+
+    Watchdog &watchdog()
+    {
+        // leaked on purpose, the detached thread may outlive static destruction
+        static auto instance = new Watchdog;
+
+        return *instance;
+    }
+}
+
+using self = TaskControl;
+
+self::~TaskControl()
+{
+    unwatch(this);
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    if (0 != m_cpuClock)
+        CloseHandle(reinterpret_cast<HANDLE>(m_cpuClock));
+#endif
+}
+
+self *self::current()
+{
+    return t_current;
+}
+
+bool self::sleep(std::chrono::milliseconds duration)
+{
+    auto control = current();
+    if (nullptr == control)
+    {
+        std::this_thread::sleep_for(duration);
+
+        return true;
+    }
+
+    return control->sleepFor(duration);
+}
+
+bool self::interrupt(Reason reason)
+{
+    auto expected = Reason::none;
+    if (!m_reason.compare_exchange_strong(expected, reason))
+        return false;
+
+    // wake up blocking builtins
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+    }
+    m_condition.notify_all();
+
+    // deliver to engines which cannot poll the flag by themselves
+    std::unique_lock<std::mutex> locker(m_callbackMutex);
+    if (nullptr != m_callback)
+        m_callback();
+
+    return true;
+}
+
+void self::setBudget(std::chrono::milliseconds wallBudget, std::chrono::milliseconds cpuBudget)
+{
+    bindCpuClock();
+
+    m_deadline = std::chrono::milliseconds::zero() < wallBudget ? std::chrono::steady_clock::now() + wallBudget : std::chrono::steady_clock::time_point::max();
+    m_cpuBudget = cpuBudget;
+    m_cpuStart = std::chrono::nanoseconds::zero();
+    m_cpuStart = cpuTime();
+}
+
+bool self::poll()
+{
+    if (interrupted())
+        return true;
+
+    if (std::chrono::steady_clock::now() >= m_deadline)
+        interrupt(Reason::wallTimeout);
+    // reading the thread cpu clock is a syscall, sample it less often than the hooks fire
+    else if (std::chrono::nanoseconds::zero() < m_cpuBudget &&
+             0 == m_polls.fetch_add(1, std::memory_order_relaxed) % cpuPollInterval &&
+             cpuTime() >= m_cpuBudget)
+        interrupt(Reason::cpuTimeout);
+
+    return interrupted();
+}
+
+std::chrono::nanoseconds self::cpuTime() const
+{
+    if (m_detached)
+        return m_cpuUsed;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (0 == m_cpuClock || !GetThreadTimes(reinterpret_cast<HANDLE>(m_cpuClock), &creationTime, &exitTime, &kernelTime, &userTime))
+        return std::chrono::nanoseconds::zero();
+
+    // 100ns units
+    auto ticks = (static_cast<uint64_t>(kernelTime.dwHighDateTime) << 32 | kernelTime.dwLowDateTime) +
+                 (static_cast<uint64_t>(userTime.dwHighDateTime) << 32 | userTime.dwLowDateTime);
+
+    return std::chrono::nanoseconds(ticks * 100) - m_cpuStart;
+#else
+    timespec time;
+    if (0 == m_cpuClock || 0 != clock_gettime(static_cast<clockid_t>(m_cpuClock), &time))
+        return std::chrono::nanoseconds::zero();
+
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec) - m_cpuStart;
+#endif
+}
+
+void self::detach()
+{
+    m_cpuUsed = cpuTime();
+    m_detached = true;
+}
+
+void self::attach()
+{
+    if (!m_detached)
+        return;
+
+    // the clock of the previous thread is of no use here
+    bindCpuClock();
+    m_detached = false;
+    m_cpuStart = std::chrono::nanoseconds::zero();
+    m_cpuStart = cpuTime() - m_cpuUsed;
+}
+
+void self::setCallback(std::function<void()> &&callback)
+{
+    std::unique_lock<std::mutex> locker(m_callbackMutex);
+
+    m_callback = std::move(callback);
+    if (interrupted() && nullptr != m_callback)
+        m_callback();
+}
+
+void self::bind(lua_State *luaState)
+{
+    lua_sethook(luaState, luaHook, LUA_MASKCOUNT, luaHookCount);
+}
+
+void self::unbind(lua_State *luaState)
+{
+    lua_sethook(luaState, nullptr, 0, 0);
+}
+
+void self::bind(JSRuntime *runtime)
+{
+    JS_SetInterruptHandler(runtime, javascriptInterruptHandler, this);
+}
+
+void self::unbind(JSRuntime *runtime)
+{
+    JS_SetInterruptHandler(runtime, nullptr, nullptr);
+}
+
+void self::bindPython()
+{
+    m_pythonInterpreter = PyThreadState_GetInterpreter(PyThreadState_Get());
+    m_pythonThreadId = PyThread_get_thread_ident();
+
+    // the callback runs under m_callbackMutex and needs the GIL, never wait for the mutex while holding it
+    Py_BEGIN_ALLOW_THREADS;
+    {
+        std::unique_lock<std::mutex> locker(m_callbackMutex);
+
+        m_callback = [this]
+        {
+            // borrow the runner's interpreter from this thread to raise inside the runner's thread
+            auto threadState = PyThreadState_New(m_pythonInterpreter);
+            PyEval_RestoreThread(threadState);
+            PyThreadState_SetAsyncExc(m_pythonThreadId, PyExc_KeyboardInterrupt);
+            PyThreadState_Clear(threadState);
+            PyThreadState_DeleteCurrent();
+        };
+    }
+    // the interpreter has no hook to poll from, let the watchdog enforce the budgets
+    if (std::chrono::steady_clock::time_point::max() != m_deadline || std::chrono::nanoseconds::zero() < m_cpuBudget)
+        watch(this);
+    Py_END_ALLOW_THREADS;
+
+    // interrupted before the script started
+    if (interrupted())
+        PyThreadState_SetAsyncExc(m_pythonThreadId, PyExc_KeyboardInterrupt);
+}
+
+void self::unbindPython()
+{
+    if (0 == m_pythonThreadId)
+        return;
+
+    // the watchdog may be delivering an interrupt and waiting for the GIL
+    Py_BEGIN_ALLOW_THREADS;
+    unwatch(this);
+    {
+        std::unique_lock<std::mutex> locker(m_callbackMutex);
+
+        m_callback = nullptr;
+    }
+    Py_END_ALLOW_THREADS;
+
+    // drop an exception that was not delivered before the script finished
+    PyThreadState_SetAsyncExc(m_pythonThreadId, nullptr);
+}
+
+void self::luaHook(lua_State *luaState, lua_Debug *debug)
+{
+    auto control = current();
+
+    if (nullptr != control && control->poll())
+    {
+        // pcall catches the error like any other, fire again on the first instruction after it returns
+        lua_sethook(luaState, luaHook, LUA_MASKCOUNT, 1);
+        luaL_error(luaState, "task interrupted");
+    }
+}
+
+int self::javascriptInterruptHandler(JSRuntime *runtime, void *opaque)
+{
+    return static_cast<TaskControl *>(opaque)->poll() ? 1 : 0;
+}
+
+void self::bindCpuClock()
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    if (0 != m_cpuClock)
+        CloseHandle(reinterpret_cast<HANDLE>(m_cpuClock));
+
+    HANDLE thread = nullptr;
+    DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &thread, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    m_cpuClock = reinterpret_cast<intptr_t>(thread);
+#else
+    clockid_t clock;
+    if (0 == pthread_getcpuclockid(pthread_self(), &clock))
+        m_cpuClock = static_cast<intptr_t>(clock);
+#endif
+}
+
+bool self::sleepFor(std::chrono::milliseconds duration)
+{
+    // do not sleep past the wall-clock budget
+    auto until = std::min(std::chrono::steady_clock::now() + duration, m_deadline);
+
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        m_condition.wait_until(locker, until, [this]
+                               { return interrupted(); });
+    }
+
+    return !poll();
+}
+
+void self::watch(TaskControl *control)
+{
+    auto &instance = watchdog();
+    std::unique_lock<std::mutex> locker(instance.mutex);
+
+    control->m_watched = true;
+    instance.controls.insert(control);
+
+    if (!instance.started)
+    {
+        instance.started = true;
+
+        std::thread(
+            [&instance]
+            {
+                std::unique_lock<std::mutex> locker(instance.mutex);
+
+                for (;;)
+                {
+                    instance.condition.wait(locker, [&instance]
+                                            { return !instance.controls.empty(); });
+
+                    // unwatch(...) waits for the mutex, the controls stay alive while polled
+                    for (auto control : instance.controls)
+                        control->poll();
+
+                    instance.condition.wait_for(locker, Watchdog::interval);
+                }
+            })
+            .detach();
+    }
+    else
+        instance.condition.notify_one();
+}
+
+void self::unwatch(TaskControl *control)
+{
+    if (!control->m_watched)
+        return;
+
+    auto &instance = watchdog();
+    std::unique_lock<std::mutex> locker(instance.mutex);
+
+    control->m_watched = false;
+    instance.controls.erase(control);
+}
\ No newline at end of file
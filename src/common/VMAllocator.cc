@@ -0,0 +1,273 @@
+#include "VMAllocator.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+using self = VMAllocator;
+
+namespace
+{
+    // pooled vms may be closed by thread_local destructors which run after the pool is gone
+    thread_local bool t_poolReleased = false;
+}
+
+struct self::Pool
+{
+    struct Block
+    {
+        Block *next;
+    };
+
+    Block *heads[classCount] = {};
+    uint32_t counts[classCount] = {};
+
+    ~Pool()
+    {
+        for (auto head : heads)
+            while (nullptr != head)
+            {
+                auto next = head->next;
+                std::free(head);
+                head = next;
+            }
+
+        t_poolReleased = true;
+    }
+};
+
+self::VMAllocator(size_t limit, TaskControl *control)
+    : m_limit(limit),
+      m_control(control)
+{
+}
+
+lua_State *self::newLuaState()
+{
+    // 64 bit luajit builds without GC64 refuse custom allocators
+    auto luaState = lua_newstate(luaAlloc, this);
+    if (nullptr == luaState)
+        luaState = luaL_newstate();
+
+    return luaState;
+}
+
+void self::arm(size_t limit, TaskControl *control)
+{
+    m_limit = limit;
+    m_control = control;
+    m_peak = m_used;
+    m_exhausted = false;
+}
+
+JSRuntime *self::newJavascriptRuntime()
+{
+    static const JSMallocFunctions functions{
+        javascriptMalloc,
+        javascriptFree,
+        javascriptRealloc,
+        javascriptMallocUsableSize,
+    };
+
+    return JS_NewRuntime2(&functions, this);
+}
+
+self::Pool &self::pool()
+{
+    thread_local Pool instance;
+
+    return instance;
+}
+
+size_t self::sizeClass(size_t size)
+{
+    return (size - 1) / classGranularity;
+}
+
+void *self::luaAlloc(void *userData, void *pointer, size_t oldSize, size_t newSize)
+{
+    auto allocator = static_cast<self *>(userData);
+
+    // lua passes the object type as oldSize for new blocks
+    if (nullptr == pointer)
+        oldSize = 0;
+
+    if (0 == newSize)
+    {
+        if (nullptr != pointer)
+        {
+            allocator->deallocate(pointer, oldSize);
+            allocator->reserve(oldSize, 0);
+        }
+
+        return nullptr;
+    }
+
+    if (!allocator->reserve(oldSize, newSize))
+        return nullptr;
+
+    auto result = nullptr == pointer ? allocator->allocate(newSize) : allocator->reallocate(pointer, oldSize, newSize);
+    if (nullptr == result)
+    {
+        allocator->reserve(newSize, oldSize);
+
+        // lua requires shrinking to succeed, keep the old block
+        if (newSize <= oldSize)
+            return pointer;
+    }
+
+    return result;
+}
+
+void *self::javascriptMalloc(JSMallocState *state, size_t size)
+{
+    auto allocator = static_cast<self *>(state->opaque);
+
+    if (!allocator->reserve(0, size))
+        return nullptr;
+
+    auto block = static_cast<uint8_t *>(allocator->allocate(headerSize + size));
+    if (nullptr == block)
+    {
+        allocator->reserve(size, 0);
+
+        return nullptr;
+    }
+    *reinterpret_cast<size_t *>(block) = size;
+
+    state->malloc_count++;
+    state->malloc_size += size;
+
+    return block + headerSize;
+}
+
+void self::javascriptFree(JSMallocState *state, void *pointer)
+{
+    if (nullptr == pointer)
+        return;
+
+    auto allocator = static_cast<self *>(state->opaque);
+    auto block = static_cast<uint8_t *>(pointer) - headerSize;
+    auto size = *reinterpret_cast<size_t *>(block);
+
+    state->malloc_count--;
+    state->malloc_size -= size;
+
+    allocator->deallocate(block, headerSize + size);
+    allocator->reserve(size, 0);
+}
+
+void *self::javascriptRealloc(JSMallocState *state, void *pointer, size_t size)
+{
+    if (nullptr == pointer)
+        return 0 == size ? nullptr : javascriptMalloc(state, size);
+
+    if (0 == size)
+    {
+        javascriptFree(state, pointer);
+
+        return nullptr;
+    }
+
+    auto allocator = static_cast<self *>(state->opaque);
+    auto block = static_cast<uint8_t *>(pointer) - headerSize;
+    auto oldSize = *reinterpret_cast<size_t *>(block);
+
+    if (!allocator->reserve(oldSize, size))
+        return nullptr;
+
+    block = static_cast<uint8_t *>(allocator->reallocate(block, headerSize + oldSize, headerSize + size));
+    if (nullptr == block)
+    {
+        allocator->reserve(size, oldSize);
+
+        return nullptr;
+    }
+    *reinterpret_cast<size_t *>(block) = size;
+
+    state->malloc_size += size;
+    state->malloc_size -= oldSize;
+
+    return block + headerSize;
+}
+
+size_t self::javascriptMallocUsableSize(const void *pointer)
+{
+    if (nullptr == pointer)
+        return 0;
+
+    return *reinterpret_cast<const size_t *>(static_cast<const uint8_t *>(pointer) - headerSize);
+}
+
+bool self::reserve(size_t oldSize, size_t newSize)
+{
+    if (newSize > oldSize && 0 != m_limit && m_used - oldSize + newSize > m_limit)
+    {
+        m_exhausted = true;
+        if (nullptr != m_control)
+            m_control->interrupt(TaskControl::Reason::memoryLimit);
+
+        return false;
+    }
+
+    m_used = m_used - oldSize + newSize;
+    m_peak = std::max(m_peak, m_used);
+
+    return true;
+}
+
+void *self::allocate(size_t size)
+{
+    if (size > maxPooledSize)
+        return std::malloc(size);
+
+    auto index = sizeClass(size);
+    if (t_poolReleased)
+        return std::malloc((index + 1) * classGranularity);
+    auto &local = pool();
+
+    auto block = local.heads[index];
+    if (nullptr == block)
+        return std::malloc((index + 1) * classGranularity);
+
+    local.heads[index] = block->next;
+    local.counts[index]--;
+
+    return block;
+}
+
+void self::deallocate(void *pointer, size_t size)
+{
+    if (size > maxPooledSize || t_poolReleased)
+        return std::free(pointer);
+
+    auto index = sizeClass(size);
+    auto &local = pool();
+
+    if (local.counts[index] >= maxPooledBlocks)
+        return std::free(pointer);
+
+    auto block = static_cast<Pool::Block *>(pointer);
+    block->next = local.heads[index];
+    local.heads[index] = block;
+    local.counts[index]++;
+}
+
+void *self::reallocate(void *pointer, size_t oldSize, size_t newSize)
+{
+    if (oldSize > maxPooledSize && newSize > maxPooledSize)
+        return std::realloc(pointer, newSize);
+
+    // the block already has room for the new size
+    if (oldSize <= maxPooledSize && newSize <= maxPooledSize && sizeClass(oldSize) == sizeClass(newSize))
+        return pointer;
+
+    auto result = allocate(newSize);
+    if (nullptr == result)
+        return nullptr;
+
+    std::memcpy(result, pointer, std::min(oldSize, newSize));
+    deallocate(pointer, oldSize);
+
+    return result;
+}
\ No newline at end of file
@@ -1,9 +1,67 @@
 #include "global.h"
 
-ThreadPool g_threadPool;
+#include <luajit/src/lua.hpp>
+
+// stealing gives every worker a queue of its own, which only pays off on many cores. compare with benchmarks/threadpool.cc
+ThreadPool::Mode g_threadPoolMode = ThreadPool::Mode::shared;
+
+ThreadPool g_threadPool(
+    std::thread::hardware_concurrency() + 3,
+    (std::thread::hardware_concurrency() + 3) * 8,
+    g_threadPoolMode,
+    std::chrono::seconds(60));
+
+Scheduler g_scheduler(g_threadPool, g_threadPool.maxSize(), std::max<size_t>(1, g_threadPool.minSize() / 2));
+
+// timers and transfers of suspended tasks
+EventLoop g_eventLoop;
+
+// worker processes of the prefork mode
+ProcessPool g_processPool;
 
 const char *g_serviceAddress = "127.0.0.1";
 
 uint16_t g_servicePort = 16888;
 
-const char *g_serviceKey = "Bzi_Han";
\ No newline at end of file
+const char *g_serviceKey = "Bzi_Han";
+
+// packets to clients which negotiated compression are deflated from this size on, smaller ones gain too little
+size_t g_compressionThreshold = 256;
+
+// limits applied to tasks which do not carry their own budgets
+std::chrono::milliseconds g_defaultWallBudget = std::chrono::minutes(30);
+
+std::chrono::milliseconds g_defaultCpuBudget = std::chrono::minutes(10);
+
+size_t g_defaultMemoryLimit = 256 * 1024 * 1024;
+
+// bind modules on first access instead of when a vm is created, compare the *pool.bind_us metrics to measure
+bool g_lazyModuleBinding = true;
+
+// compiled lua runs 1.1-3.9x faster, but its traces skip the hook, so stop and the budgets reach a hot loop only in the prefork mode where the worker is killed
+bool g_luaJit = true;
+
+// run lua tasks as coroutines, system.delay and requests.* suspend them instead of blocking their thread
+bool g_luaCoroutines = true;
+
+// run tasks in this many worker processes forked from a preinitialized zygote, linux only. zero runs them in the core
+size_t g_preforkWorkers = 0;
+
+// bounds of the warm vms kept for sticky tasks, per language
+size_t g_stickyMemoryLimit = 512 * 1024 * 1024;
+
+size_t g_stickyMaxVMs = 64;
+
+// compiled scripts are also kept here when not empty, so they survive restarts
+const char *g_scriptCacheDirectory = "";
+
+ScriptCache g_luaScriptCache("luacache", 64 * 1024 * 1024, LUAJIT_VERSION, g_scriptCacheDirectory);
+
+// quickjs rejects bytecode of another version on load, such entries are simply compiled again
+ScriptCache g_javascriptScriptCache("jscache", 64 * 1024 * 1024, "quickjs", g_scriptCacheDirectory);
+
+// drop line numbers and sources from compiled javascript, needs a quickjs with JS_SetStripInfo
+bool g_javascriptStripDebug = false;
+
+// entries are keyed by the magic number of the interpreter, as .pyc files are
+ScriptCache g_pythonScriptCache("pycache", 64 * 1024 * 1024, "cpython", g_scriptCacheDirectory);
\ No newline at end of file
@@ -1,10 +1,60 @@
 #include "global.h"
 #include "service.h"
 #include "ModuleTools.h"
+#include "Metrics.h"
 
 #include <yasio/yasio/obstream.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // the fields of a runBatch descriptor behind its strings: priority, budgets, memory and ttl
+    constexpr size_t runOptionsSize = 4 + 4 + 4 + 8 + 4;
+
+    // a runBatch descriptor with empty strings: ids, language, four string lengths and the options
+    constexpr size_t minRunDescriptorSize = 8 + 8 + 1 + 4 * 4 + runOptionsSize;
+
+    // a runner id of stopBatch and statusBatch
+    constexpr size_t runnerIdSize = 8;
+
+    // bytes of the frame behind the read position
+    size_t remaining(yasio::ibstream_view &ibs)
+    {
+        return ibs.length() - static_cast<size_t>(ibs.tell());
+    }
+
+    // read the count of a batch frame, 0 if the frame cannot hold that many records of `recordSize` bytes
+    uint32_t readBatchCount(yasio::ibstream_view &ibs, size_t recordSize)
+    {
+        if (sizeof(uint32_t) > remaining(ibs))
+            return 0;
+
+        auto count = ibs.read<uint32_t>();
+        if (static_cast<uint64_t>(count) * recordSize > remaining(ibs))
+            return 0;
+
+        return count;
+    }
+
+    // read a length prefixed string into `value`, false if the length points past the end of the frame
+    bool readString(yasio::ibstream_view &ibs, std::string &value)
+    {
+        if (sizeof(uint32_t) > remaining(ibs))
+            return false;
+
+        auto length = ibs.read<uint32_t>();
+        ibs.seek(-static_cast<int>(sizeof(uint32_t)), SEEK_CUR);
+        if (length > remaining(ibs) - sizeof(uint32_t))
+            return false;
+
+        value = ibs.read_v32();
+        return true;
+    }
+}
 
 int main()
 {
@@ -16,22 +66,48 @@ int main()
     {
         auto taskRunInfo = static_cast<Service::task_run_info_t *>(userData);
 
-        yasio::obstream obs;
-        auto packetSize = obs.push<uint32_t>();
-        obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::log));
-        obs.write<uint64_t>(taskRunInfo->userId);
-        obs.write<uint64_t>(taskRunInfo->taskId);
-        obs.write_byte(static_cast<uint8_t>(logType));
-        obs.write_v32(taskRunInfo->taskName);
-        obs.write_v32(message);
-        obs.pop<uint32_t>(packetSize);
-
-        g_service.backward(taskRunInfo->clientId, std::move(obs.buffer()));
+        g_logBatcher.append(
+            taskRunInfo->clientId,
+            taskRunInfo->requestId,
+            taskRunInfo->runnerId,
+            taskRunInfo->userId,
+            taskRunInfo->taskId,
+            taskRunInfo->taskName,
+            static_cast<uint8_t>(logType),
+            message);
     };
 
+    // python is initialized once, tasks run in pooled sub-interpreters. in the prefork mode the zygote does so
+    if (0 < g_preforkWorkers && Service::prefork(g_preforkWorkers))
+        std::cout << "[=] Prefork worker processes: " << g_preforkWorkers << std::endl;
+    else
+        PythonVMPool::initialize();
+
+    // export thread pool metrics
+    Metrics::gauge("threadpool.size", []
+                   { return static_cast<int64_t>(g_threadPool.statistics().size); });
+    Metrics::gauge("threadpool.idle", []
+                   { return static_cast<int64_t>(g_threadPool.statistics().idle); });
+    Metrics::gauge("threadpool.blocked", []
+                   { return static_cast<int64_t>(g_threadPool.statistics().blocked); });
+    Metrics::gauge("threadpool.pending", []
+                   { return static_cast<int64_t>(g_threadPool.statistics().pending); });
+    Metrics::gauge("threadpool.spawned", []
+                   { return static_cast<int64_t>(g_threadPool.statistics().spawned); });
+    Metrics::gauge("threadpool.retired", []
+                   { return static_cast<int64_t>(g_threadPool.statistics().retired); });
+    Metrics::gauge("scheduler.pending", []
+                   { return static_cast<int64_t>(g_scheduler.pending()); });
+    Metrics::gauge("scheduler.inflight", []
+                   { return static_cast<int64_t>(g_scheduler.inflight()); });
+    Metrics::gauge("processpool.size", []
+                   { return static_cast<int64_t>(g_processPool.size()); });
+    Metrics::gauge("processpool.idle", []
+                   { return static_cast<int64_t>(g_processPool.idle()); });
+
     g_service.addEventHandler(
         NetworkService::command_t::run,
-        [&](uint32_t clientId, yasio::ibstream_view &ibs)
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
         {
             auto userId = ibs.read<uint64_t>();
             auto taskId = ibs.read<uint64_t>();
@@ -40,6 +116,20 @@ int main()
             auto script = ibs.read_v32();
             auto passport = ibs.read_v32();
             auto callMethods = ibs.read_v32();
+
+            // optional fields appended by newer controllers
+            Service::run_options_t options;
+            if (static_cast<size_t>(ibs.tell()) < ibs.length())
+                options.priority = ibs.read<int32_t>();
+            if (static_cast<size_t>(ibs.tell()) < ibs.length())
+                options.wallBudget = std::chrono::milliseconds(ibs.read<uint32_t>());
+            if (static_cast<size_t>(ibs.tell()) < ibs.length())
+                options.cpuBudget = std::chrono::milliseconds(ibs.read<uint32_t>());
+            if (static_cast<size_t>(ibs.tell()) < ibs.length())
+                options.memoryLimit = static_cast<size_t>(ibs.read<uint64_t>());
+            if (static_cast<size_t>(ibs.tell()) < ibs.length())
+                options.stickyTtl = std::chrono::milliseconds(ibs.read<uint32_t>());
+
             auto runnerId = Service::run(
                 clientId,
                 userId,
@@ -48,7 +138,9 @@ int main()
                 {name.data(), name.size()},
                 {script.data(), script.size()},
                 {passport.data(), passport.size()},
-                {callMethods.data(), callMethods.size()});
+                {callMethods.data(), callMethods.size()},
+                options,
+                requestId);
 
             yasio::obstream obs;
             auto packetSize = obs.push<uint32_t>();
@@ -57,12 +149,12 @@ int main()
             obs.write<uint64_t>(runnerId);
             obs.pop<uint32_t>(packetSize);
 
-            g_service.backward(clientId, std::move(obs.buffer()));
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
         });
 
     g_service.addEventHandler(
         NetworkService::command_t::stop,
-        [&](uint32_t clientId, yasio::ibstream_view &ibs)
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
         {
             auto runnerId = ibs.read<uint64_t>();
 
@@ -72,12 +164,12 @@ int main()
             obs.write_byte(static_cast<uint8_t>(Service::stop(runnerId)));
             obs.pop<uint32_t>(packetSize);
 
-            g_service.backward(clientId, std::move(obs.buffer()));
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
         });
 
     g_service.addEventHandler(
         NetworkService::command_t::status,
-        [&](uint32_t clientId, yasio::ibstream_view &ibs)
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
         {
             auto runnerId = ibs.read<uint64_t>();
 
@@ -87,7 +179,133 @@ int main()
             obs.write_byte(static_cast<uint8_t>(Service::status(runnerId)));
             obs.pop<uint32_t>(packetSize);
 
-            g_service.backward(clientId, std::move(obs.buffer()));
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
+        });
+
+    g_service.addEventHandler(
+        NetworkService::command_t::runBatch,
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
+        {
+            // count, then descriptors laid out as in run with every optional field present. a frame too short for its
+            // descriptors runs none of them and gets an empty reply
+            auto count = readBatchCount(ibs, minRunDescriptorSize);
+
+            std::vector<Service::run_descriptor_t> descriptors;
+            descriptors.reserve(count);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                // the strings of the descriptors before may have used up the frame
+                if (minRunDescriptorSize > remaining(ibs))
+                {
+                    descriptors.clear();
+                    break;
+                }
+
+                auto &descriptor = descriptors.emplace_back();
+                descriptor.userId = ibs.read<uint64_t>();
+                descriptor.taskId = ibs.read<uint64_t>();
+                descriptor.language = ibs.read<Service::language_t>();
+                // a string may claim more bytes than are left, the options behind it must still fit too
+                if (!readString(ibs, descriptor.name) || !readString(ibs, descriptor.script) || !readString(ibs, descriptor.passport) ||
+                    !readString(ibs, descriptor.callMethods) || runOptionsSize > remaining(ibs))
+                {
+                    descriptors.clear();
+                    break;
+                }
+                descriptor.options.priority = ibs.read<int32_t>();
+                descriptor.options.wallBudget = std::chrono::milliseconds(ibs.read<uint32_t>());
+                descriptor.options.cpuBudget = std::chrono::milliseconds(ibs.read<uint32_t>());
+                descriptor.options.memoryLimit = static_cast<size_t>(ibs.read<uint64_t>());
+                descriptor.options.stickyTtl = std::chrono::milliseconds(ibs.read<uint32_t>());
+            }
+
+            auto runnerIds = Service::run(clientId, std::move(descriptors), requestId);
+
+            yasio::obstream obs;
+            auto packetSize = obs.push<uint32_t>();
+            obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::runBatch));
+            obs.write<uint32_t>(static_cast<uint32_t>(runnerIds.size()));
+            for (auto runnerId : runnerIds)
+            {
+                obs.write_byte(0 != runnerId);
+                obs.write<uint64_t>(runnerId);
+            }
+            obs.pop<uint32_t>(packetSize);
+
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
+        });
+
+    g_service.addEventHandler(
+        NetworkService::command_t::stopBatch,
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
+        {
+            // a frame too short for its runner ids gets an empty reply
+            auto count = readBatchCount(ibs, runnerIdSize);
+
+            yasio::obstream obs;
+            auto packetSize = obs.push<uint32_t>();
+            obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::stopBatch));
+            obs.write<uint32_t>(count);
+            for (uint32_t i = 0; i < count; i++)
+                obs.write_byte(static_cast<uint8_t>(Service::stop(ibs.read<uint64_t>())));
+            obs.pop<uint32_t>(packetSize);
+
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
+        });
+
+    g_service.addEventHandler(
+        NetworkService::command_t::statusBatch,
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
+        {
+            // a frame too short for its runner ids gets an empty reply
+            auto count = readBatchCount(ibs, runnerIdSize);
+
+            yasio::obstream obs;
+            auto packetSize = obs.push<uint32_t>();
+            obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::statusBatch));
+            obs.write<uint32_t>(count);
+            for (uint32_t i = 0; i < count; i++)
+                obs.write_byte(static_cast<uint8_t>(Service::status(ibs.read<uint64_t>())));
+            obs.pop<uint32_t>(packetSize);
+
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
+        });
+
+    g_service.addEventHandler(
+        NetworkService::command_t::invalidate,
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
+        {
+            auto userId = ibs.read<uint64_t>();
+            auto taskId = ibs.read<uint64_t>();
+
+            yasio::obstream obs;
+            auto packetSize = obs.push<uint32_t>();
+            obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::invalidate));
+            // 0 nothing to drop, 1 dropped, 2 rejected in the prefork mode
+            obs.write_byte(static_cast<uint8_t>(Service::invalidate(userId, taskId)));
+            obs.pop<uint32_t>(packetSize);
+
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
+        });
+
+    g_service.addEventHandler(
+        NetworkService::command_t::metrics,
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
+        {
+            auto metrics = Metrics::snapshot();
+
+            yasio::obstream obs;
+            auto packetSize = obs.push<uint32_t>();
+            obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::metrics));
+            obs.write<uint32_t>(static_cast<uint32_t>(metrics.size()));
+            for (const auto &[name, value] : metrics)
+            {
+                obs.write_v32(name);
+                obs.write<int64_t>(value);
+            }
+            obs.pop<uint32_t>(packetSize);
+
+            g_service.backward(clientId, std::move(obs.buffer()), requestId);
         });
 
     std::string command;
@@ -2,6 +2,9 @@
 
 NetworkService g_service(g_serviceAddress, g_servicePort);
 
+// log lines go out per client once 64 KiB are queued or 5 ms after the first one
+LogBatcher g_logBatcher(g_service, 64 * 1024, std::chrono::milliseconds(5));
+
 namespace Service::Detail
 {
     bool lua(
@@ -12,120 +15,132 @@ namespace Service::Detail
         const std::string &script,
         const std::string &passport,
         const std::string &callMethods,
-        std::promise<uint64_t> *runnerId)
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
     {
-        bool result = false;
-        TaskRunInfo runInfo{clientId, userId, taskId, TaskRunStatus::waiting, name};
-
-        // create lua vm
-        lua_State *luaState = luaL_newstate();
-        if (nullptr == luaState)
+        // the run outlives this call when the task suspends in a builtin
+        struct Run
         {
-            ModuleTools::Logger::failed({"create lua vm failed"}, &runInfo);
-            runnerId->set_value(0);
-
-            return result;
-        }
-        taskRunInfo.emplace(reinterpret_cast<uint64_t>(luaState), &runInfo);
-
-        // construction finally block
-        finally
-        {
-            yasio::obstream obs;
-
-            runInfo.status = TaskRunStatus::finished;
+            LuaVMPool::Lease vm;
+            std::optional<StickyTicket> ticket;
+            bool result = false;
+        };
 
-            auto packetSize = obs.push<uint32_t>();
-            obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::result));
-            obs.write<uint64_t>(userId);
-            obs.write<uint64_t>(taskId);
-            obs.write_byte(result);
-            obs.write<uint64_t>(reinterpret_cast<uint64_t>(luaState));
-            obs.pop<uint32_t>(packetSize);
+        auto &runInfo = *runInfoHolder;
 
-            g_service.backward(clientId, std::move(obs.buffer()));
+        // sticky tasks resume their warm vm, which still has the script loaded and the passport set
+        std::optional<StickyTicket> ticket;
+        if (std::chrono::milliseconds::zero() < options.stickyTtl)
+            ticket = StickyTicket{userId, taskId, ModuleCrypto::sha256(script + '\0' + passport), options.stickyTtl};
 
-            lua_close(luaState);
-            taskRunInfo.erase(reinterpret_cast<uint64_t>(luaState));
-        };
+        // acquire a pooled lua vm
+        auto vm = LuaVMPool::acquire(&runInfo, ticket.has_value() ? &*ticket : nullptr);
+        lua_State *luaState = vm.state();
 
-        // initialization environment
-        luaL_openlibs(luaState);
+        // report the result once the last holder lets go, on whichever thread the task finished
+        auto run = std::shared_ptr<Run>(
+            new Run{std::move(vm), std::move(ticket)},
+            [=](Run *run)
+            {
+                yasio::obstream obs;
+                auto &runInfo = *runInfoHolder;
+
+                runInfo.status = TaskRunStatus::finished;
+
+                auto packetSize = obs.push<uint32_t>();
+                obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::result));
+                obs.write<uint64_t>(userId);
+                obs.write<uint64_t>(taskId);
+                obs.write_byte(run->result);
+                obs.write<uint64_t>(runnerId);
+                obs.write_byte(static_cast<uint8_t>(runInfo.control.reason()));
+                obs.write<uint64_t>(nullptr == luaState ? 0 : run->vm.allocator().peak());
+                obs.pop<uint32_t>(packetSize);
+
+                // the log lines of the task go out before its result
+                g_logBatcher.finish(clientId, runnerId);
+                g_service.backward(clientId, std::move(obs.buffer()), runInfo.requestId);
+
+                // the vm goes back to the pool when the lease ends
+                if (nullptr != luaState)
+                {
+                    runInfo.control.unbind(luaState);
+                    if (TaskControl::Reason::memoryLimit == runInfo.control.reason())
+                        run->vm.discard();
+                }
+                unregisterRunInfo(runnerId);
 
-        // register modules
-        ModuleCrypto::bind(luaState);
-        ModuleJson::bind(luaState);
-        ModuleRequests::bind(luaState);
-        ModuleTools::bind(luaState, &runInfo);
-        ModuleSystem::bind(luaState);
+                delete run;
+            });
 
-        // notify runnerId
-        runnerId->set_value(reinterpret_cast<uint64_t>(luaState));
+        if (nullptr == luaState)
+        {
+            ModuleTools::Logger::failed({"create lua vm failed"}, &runInfo);
 
-        // load sciprt environment
-        if (LUA_OK != luaL_dostring(luaState, script.c_str()))
+            return false;
+        }
+        run->vm.allocator().arm(options.memoryLimit, &runInfo.control);
+
+        // install interrupt checks
+        TaskControl::Scope controlScope(&runInfo.control);
+        runInfo.control.setBudget(options.wallBudget, options.cpuBudget);
+        runInfo.control.bind(luaState);
+
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return false;
+
+        // the runner runs the chunk, setTaskPassport and the methods, a warm vm skips the first two
+        LuaVMPool::pushRunner(luaState);
+        if (run->vm.warm())
+            lua_pushnil(luaState);
+        else if (LUA_OK != LuaVMPool::load(luaState, script))
         {
             ModuleTools::Logger::failed({lua_tostring(luaState, -1)}, &runInfo);
+            lua_settop(luaState, 0);
 
-            return result;
+            return false;
         }
+        lua_pushstring(luaState, passport.c_str());
 
-        runInfo.status = TaskRunStatus::running;
         auto methods = stringSplitAscii(callMethods, ",");
-        for (size_t i = 0; i < methods.size() + 1; i++)
+        if (!lua_checkstack(luaState, static_cast<int>(methods.size())))
         {
-            // get target method
-            lua_getglobal(luaState, 0 == i ? "setTaskPassport" : methods[i - 1].c_str());
-            // check target value if is not a function
-            if (!lua_isfunction(luaState, -1))
-            {
-                ModuleTools::Logger::failed(
-                    {
-                        0 == i ? "setTaskPassport" : methods[i - 1],
-                        "is not a function",
-                    },
-                    &runInfo);
+            ModuleTools::Logger::failed({"too many methods"}, &runInfo);
+            lua_settop(luaState, 0);
 
-                return result;
-            }
-
-            // call target method
-            bool isCallSucceed = false;
-            if (0 == i)
-            {
-                lua_pushstring(luaState, passport.c_str());
-                isCallSucceed = LUA_OK == lua_pcall(luaState, 1, 1, 0);
-            }
-            else
-                isCallSucceed = LUA_OK == lua_pcall(luaState, 0, 1, 0);
+            return false;
+        }
+        for (auto &method : methods)
+            lua_pushstring(luaState, method.c_str());
 
-            // check call result
-            if (!isCallSucceed)
+        // as a coroutine, builtins which wait suspend the task and give this thread back
+        runInfo.status = TaskRunStatus::running;
+        LuaCoroutine::start(
+            luaState,
+            static_cast<int>(methods.size()) + 2,
+            &runInfo.control,
+            [run, runInfoHolder](int status, lua_State *thread)
             {
-                ModuleTools::Logger::failed({lua_tostring(luaState, -1)}, &runInfo);
+                auto &runInfo = *runInfoHolder;
 
-                return false;
-            }
-            else if (0 != i)
-            {
-                if (!lua_isboolean(luaState, -1))
+                if (LUA_OK != status)
+                    ModuleTools::Logger::failed({lua_tostring(thread, -1)}, &runInfo);
+                else if (lua_isnil(thread, 1))
+                    ModuleTools::Logger::failed({lua_tostring(thread, 2), lua_tostring(thread, 3)}, &runInfo);
+                else
                 {
-                    ModuleTools::Logger::failed(
-                        {
-                            methods[i - 1],
-                            "return value is not a boolean",
-                        },
-                        &runInfo);
+                    run->result = lua_toboolean(thread, 1);
 
-                    return result;
+                    // a completed run keeps its vm warm for the next one
+                    if (run->ticket.has_value())
+                        run->vm.stick();
                 }
+            });
 
-                result = lua_toboolean(luaState, -1);
-                lua_pop(luaState, 1);
-            }
-        }
-
-        return result;
+        // the result is reported by the deleter of the run, maybe from another thread
+        return true;
     }
 
     bool python(
@@ -136,31 +151,22 @@ namespace Service::Detail
         const std::string &script,
         const std::string &passport,
         const std::string &callMethods,
-        std::promise<uint64_t> *runnerId)
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
     {
         bool result = false;
-        TaskRunInfo runInfo{clientId, userId, taskId, TaskRunStatus::waiting, name};
+        auto &runInfo = *runInfoHolder;
 
-        // create python vm
-        Py_Initialize();
-        PyObject *mainModule, *globalDict;
-        mainModule = PyImport_AddModule("__main__");
-        if (nullptr == mainModule)
-        {
-            ModuleTools::Logger::failed({"create python vm failed"}, &runInfo);
-            runnerId->set_value(0);
-
-            return result;
-        }
-        globalDict = PyModule_GetDict(mainModule);
-        if (nullptr == globalDict)
-        {
-            ModuleTools::Logger::failed({"get python structure failed"}, &runInfo);
-            runnerId->set_value(0);
+        // sticky tasks resume their warm vm, which still has the script loaded and the passport set
+        std::optional<StickyTicket> ticket;
+        if (std::chrono::milliseconds::zero() < options.stickyTtl)
+            ticket = StickyTicket{userId, taskId, ModuleCrypto::sha256(script + '\0' + passport), options.stickyTtl};
 
-            return result;
-        }
-        taskRunInfo.emplace(reinterpret_cast<uint64_t>(mainModule), &runInfo);
+        // acquire a pooled python interpreter, its gil is held until the lease ends
+        auto vm = PythonVMPool::acquire(&runInfo, ticket.has_value() ? &*ticket : nullptr);
+        PyObject *mainModule, *globalDict;
+        mainModule = vm.mainModule();
 
         // construction finally block
         finally
@@ -174,39 +180,62 @@ namespace Service::Detail
             obs.write<uint64_t>(userId);
             obs.write<uint64_t>(taskId);
             obs.write_byte(result);
-            obs.write<uint64_t>(reinterpret_cast<uint64_t>(mainModule));
+            obs.write<uint64_t>(runnerId);
+            obs.write_byte(static_cast<uint8_t>(runInfo.control.reason()));
+            obs.write<uint64_t>(0);
             obs.pop<uint32_t>(packetSize);
 
-            g_service.backward(clientId, std::move(obs.buffer()));
+            // the log lines of the task go out before its result
+            g_logBatcher.finish(clientId, runnerId);
+            g_service.backward(clientId, std::move(obs.buffer()), runInfo.requestId);
 
-            Py_Finalize();
-            taskRunInfo.erase(reinterpret_cast<uint64_t>(mainModule));
+            // the interpreter is reset and goes back to the pool when the lease ends
+            runInfo.control.unbindPython();
+            unregisterRunInfo(runnerId);
         };
 
-        // register modules
-        ModuleCrypto::bind(mainModule);
-        ModuleJson::bind(mainModule);
-        ModuleRequests::bind(mainModule);
-        ModuleTools::bind(mainModule, &runInfo);
-        ModuleSystem::bind(mainModule);
+        if (nullptr == mainModule)
+        {
+            ModuleTools::Logger::failed({"create python vm failed"}, &runInfo);
+
+            return result;
+        }
+        globalDict = PyModule_GetDict(mainModule);
+        if (nullptr == globalDict)
+        {
+            ModuleTools::Logger::failed({"get python structure failed"}, &runInfo);
+
+            return result;
+        }
+
+        // install interrupt delivery
+        TaskControl::Scope controlScope(&runInfo.control);
+        runInfo.control.setBudget(options.wallBudget, options.cpuBudget);
+        runInfo.control.bindPython();
 
-        // notify runnerId
-        runnerId->set_value(reinterpret_cast<uint64_t>(mainModule));
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return result;
 
         try
         {
             // load sciprt environment
-            if (nullptr == PyRun_String(script.c_str(), Py_file_input, globalDict, globalDict))
+            if (!vm.warm())
             {
-                ModuleTools::Logger::failed({pybind11::cast<std::string>(pybind11::error_scope().value)}, &runInfo);
+                auto loadResult = vm.run(script);
+                if (nullptr == loadResult)
+                {
+                    ModuleTools::Logger::failed({pybind11::cast<std::string>(pybind11::error_scope().value)}, &runInfo);
 
-                return result;
+                    return result;
+                }
+                Py_DECREF(loadResult);
             }
 
             runInfo.status = TaskRunStatus::running;
             auto methods = stringSplitAscii(callMethods, ",");
 
-            for (int i = 0; i < methods.size() + 1; i++)
+            for (int i = vm.warm() ? 1 : 0; i < methods.size() + 1; i++)
             {
                 if (0 == i)
                     pybind11::getattr(mainModule, "setTaskPassport")(passport);
@@ -217,6 +246,10 @@ namespace Service::Detail
                     result = pybind11::cast<bool>(callResult);
                 }
             }
+
+            // a completed run keeps its interpreter warm for the next one
+            if (ticket.has_value())
+                vm.stick();
         }
         catch (const std::exception &e)
         {
@@ -236,29 +269,17 @@ namespace Service::Detail
         const std::string &script,
         const std::string &passport,
         const std::string &callMethods,
-        std::promise<uint64_t> *runnerId)
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
     {
         bool result = false;
-        TaskRunInfo runInfo{clientId, userId, taskId, TaskRunStatus::waiting, name};
-
-        // create javascript vm
-        auto runtime = JS_NewRuntime();
-        if (nullptr == runtime)
-        {
-            ModuleTools::Logger::failed({"create javascript vm failed"}, &runInfo);
-            runnerId->set_value(0);
+        auto &runInfo = *runInfoHolder;
 
-            return result;
-        }
-        auto context = JS_NewContext(runtime);
-        if (nullptr == context)
-        {
-            ModuleTools::Logger::failed({"create javascript context failed"}, &runInfo);
-            runnerId->set_value(0);
-
-            return result;
-        }
-        taskRunInfo.emplace(reinterpret_cast<uint64_t>(context), &runInfo);
+        // acquire a pooled javascript runtime with a fresh context
+        auto vm = JavascriptVMPool::acquire(&runInfo);
+        auto runtime = vm.runtime();
+        auto context = vm.context();
 
         // construction finally block
         finally
@@ -272,36 +293,62 @@ namespace Service::Detail
             obs.write<uint64_t>(userId);
             obs.write<uint64_t>(taskId);
             obs.write_byte(result);
-            obs.write<uint64_t>(reinterpret_cast<uint64_t>(context));
+            obs.write<uint64_t>(runnerId);
+            obs.write_byte(static_cast<uint8_t>(runInfo.control.reason()));
+            obs.write<uint64_t>(nullptr == runtime ? 0 : vm.allocator().peak());
             obs.pop<uint32_t>(packetSize);
 
-            g_service.backward(clientId, std::move(obs.buffer()));
+            // the log lines of the task go out before its result
+            g_logBatcher.finish(clientId, runnerId);
+            g_service.backward(clientId, std::move(obs.buffer()), runInfo.requestId);
 
-            JS_FreeContext(context);
-            JS_FreeRuntime(runtime);
-            taskRunInfo.erase(reinterpret_cast<uint64_t>(context));
+            // the context is freed and the runtime goes back to the pool when the lease ends
+            if (nullptr != runtime)
+            {
+                runInfo.control.unbind(runtime);
+                if (TaskControl::Reason::memoryLimit == runInfo.control.reason())
+                    vm.discard();
+            }
+            unregisterRunInfo(runnerId);
         };
 
-        // register modules
-        ModuleCrypto::bind(context);
-        ModuleJson::bind(context);
-        ModuleRequests::bind(context);
-        ModuleTools::bind(context, &runInfo);
-        ModuleSystem::bind(context);
+        if (nullptr == runtime)
+        {
+            ModuleTools::Logger::failed({"create javascript vm failed"}, &runInfo);
 
-        // notify runnerId
-        runnerId->set_value(reinterpret_cast<uint64_t>(context));
+            return result;
+        }
+        if (nullptr == context)
+        {
+            ModuleTools::Logger::failed({"create javascript context failed"}, &runInfo);
+
+            return result;
+        }
+        vm.allocator().arm(options.memoryLimit, &runInfo.control);
+
+        // install interrupt checks
+        TaskControl::Scope controlScope(&runInfo.control);
+        runInfo.control.setBudget(options.wallBudget, options.cpuBudget);
+        runInfo.control.bind(runtime);
+
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return result;
 
         // load sciprt environment
-        auto loadResult = JS_Eval(context, script.c_str(), script.size(), "<input>", JS_EVAL_TYPE_GLOBAL);
+        auto loadResult = JavascriptVMPool::eval(context, script);
         if (JS_IsException(loadResult))
         {
             auto exception = JS_GetException(context);
-            ModuleTools::Logger::failed({JS_ToCString(context, exception)}, &runInfo);
+            auto message = JS_ToCString(context, exception);
+            ModuleTools::Logger::failed({nullptr == message ? "" : message}, &runInfo);
+            JS_FreeCString(context, message);
             JS_FreeValue(context, exception);
 
             return result;
         }
+        // the runtime outlives this task, values must not leak into it
+        JS_FreeValue(context, loadResult);
 
         runInfo.status = TaskRunStatus::running;
         auto methods = stringSplitAscii(callMethods, ",");
@@ -327,6 +374,7 @@ namespace Service::Detail
             {
                 auto args = JS_NewString(context, passport.c_str());
                 callResult = JS_Call(context, targetFunction, globalThis, 1, &args);
+                JS_FreeValue(context, args);
             }
             else
                 callResult = JS_Call(context, targetFunction, globalThis, 0, nullptr);
@@ -336,7 +384,9 @@ namespace Service::Detail
             if (JS_IsException(callResult))
             {
                 auto exception = JS_GetException(context);
-                ModuleTools::Logger::failed({JS_ToCString(context, exception)}, &runInfo);
+                auto message = JS_ToCString(context, exception);
+                ModuleTools::Logger::failed({nullptr == message ? "" : message}, &runInfo);
+                JS_FreeCString(context, message);
                 JS_FreeValue(context, exception);
 
                 return result;
@@ -352,11 +402,14 @@ namespace Service::Detail
                         },
                         &runInfo);
 
+                    JS_FreeValue(context, callResult);
+
                     return result;
                 }
 
                 result = JS_ToBool(context, callResult);
             }
+            JS_FreeValue(context, callResult);
         }
 
         // execute remaining jobs
@@ -365,6 +418,258 @@ namespace Service::Detail
         return true;
     }
 
+    bool process(
+        LanguageType language,
+        uint32_t clientId,
+        uint64_t userId,
+        uint64_t taskId,
+        const std::string &name,
+        const std::string &script,
+        const std::string &passport,
+        const std::string &callMethods,
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
+    {
+        // a worker still running this long after the wall budget is killed, it usually stops by itself before
+        constexpr auto killGrace = std::chrono::seconds(1);
+        constexpr auto pollInterval = std::chrono::milliseconds(50);
+
+        bool reported = false;
+        auto &runInfo = *runInfoHolder;
+
+        // construction finally block
+        finally
+        {
+            runInfo.status = TaskRunStatus::finished;
+
+            // the worker is gone before it reported, e.g. it was killed or crashed
+            if (!reported)
+            {
+                yasio::obstream obs;
+
+                auto packetSize = obs.push<uint32_t>();
+                obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::result));
+                obs.write<uint64_t>(userId);
+                obs.write<uint64_t>(taskId);
+                obs.write_byte(false);
+                obs.write<uint64_t>(runnerId);
+                obs.write_byte(static_cast<uint8_t>(runInfo.control.reason()));
+                obs.write<uint64_t>(0);
+                obs.pop<uint32_t>(packetSize);
+
+                // the log lines of the task go out before its result
+                g_logBatcher.finish(clientId, runnerId);
+                g_service.backward(clientId, std::move(obs.buffer()), runInfo.requestId);
+            }
+            unregisterRunInfo(runnerId);
+        };
+
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return false;
+
+        // this thread only waits for the worker from here on
+        ThreadPool::BlockingScope blocking;
+
+        auto worker = g_processPool.acquire();
+        if (!worker.valid())
+        {
+            ModuleTools::Logger::failed({"no worker process left"}, &runInfo);
+
+            return false;
+        }
+
+        // stopping the task kills its worker
+        runInfo.control.setBudget(std::chrono::milliseconds::zero() < options.wallBudget ? options.wallBudget + killGrace : std::chrono::milliseconds::zero(), std::chrono::milliseconds::zero());
+        runInfo.control.setCallback([&worker]
+                                    { worker.kill(); });
+        finally
+        {
+            runInfo.control.setCallback(nullptr);
+        };
+
+        yasio::obstream obs;
+        obs.write_byte(static_cast<uint8_t>(language));
+        obs.write<uint64_t>(userId);
+        obs.write<uint64_t>(taskId);
+        obs.write_v32(name);
+        obs.write_v32(script);
+        obs.write_v32(passport);
+        obs.write_v32(callMethods);
+        obs.write<uint32_t>(static_cast<uint32_t>(options.wallBudget.count()));
+        obs.write<uint32_t>(static_cast<uint32_t>(options.cpuBudget.count()));
+        obs.write<uint64_t>(options.memoryLimit);
+        obs.write<uint32_t>(static_cast<uint32_t>(options.stickyTtl.count()));
+        obs.write<uint64_t>(runnerId);
+        if (!worker.send({obs.buffer().data(), obs.buffer().size()}))
+        {
+            ModuleTools::Logger::failed({"send task to worker process failed"}, &runInfo);
+
+            return false;
+        }
+
+        runInfo.status = TaskRunStatus::running;
+
+        std::string frame;
+        for (;;)
+        {
+            auto received = worker.receive(frame, pollInterval);
+            if (ProcessPool::Receive::timeout == received)
+            {
+                // exceeding the wall budget interrupts the task, which kills the worker
+                runInfo.control.poll();
+
+                continue;
+            }
+            if (ProcessPool::Receive::closed == received)
+            {
+                if (!runInfo.control.interrupted())
+                    ModuleTools::Logger::failed({"worker process exited"}, &runInfo);
+
+                return false;
+            }
+
+            // the frames are packets for the client, its result packet ends the task
+            auto command = 4 < frame.size() ? static_cast<NetworkService::command_t>(frame[4]) : NetworkService::command_t::__max;
+
+            // the worker logs line by line, the lines are batched here
+            if (NetworkService::command_t::log == command)
+            {
+                yasio::ibstream_view ibs(frame.data(), frame.size());
+                ibs.seek(5, SEEK_SET);
+
+                auto logUserId = ibs.read<uint64_t>();
+                auto logTaskId = ibs.read<uint64_t>();
+                auto logType = ibs.read<uint8_t>();
+                auto taskName = ibs.read_v32();
+                auto message = ibs.read_v32();
+                g_logBatcher.append(clientId, runInfo.requestId, runnerId, logUserId, logTaskId, taskName, logType, message);
+
+                continue;
+            }
+
+            if (NetworkService::command_t::result == command)
+                g_logBatcher.finish(clientId, runnerId);
+
+            g_service.backward(clientId, yasio::packet_t(frame.begin(), frame.end()), runInfo.requestId);
+            if (NetworkService::command_t::result == command)
+            {
+                reported = true;
+
+                return true;
+            }
+        }
+    }
+
+    void serve(std::string &&request)
+    {
+        yasio::ibstream_view ibs(request.data(), request.size());
+
+        auto language = ibs.read<LanguageType>();
+        auto userId = ibs.read<uint64_t>();
+        auto taskId = ibs.read<uint64_t>();
+        auto name = ibs.read_v32();
+        auto script = ibs.read_v32();
+        auto passport = ibs.read_v32();
+        auto callMethods = ibs.read_v32();
+
+        RunOptions options;
+        options.wallBudget = std::chrono::milliseconds(ibs.read<uint32_t>());
+        options.cpuBudget = std::chrono::milliseconds(ibs.read<uint32_t>());
+        options.memoryLimit = static_cast<size_t>(ibs.read<uint64_t>());
+        options.stickyTtl = std::chrono::milliseconds(ibs.read<uint32_t>());
+        auto runnerId = ibs.read<uint64_t>();
+
+        decltype(&lua) runner = nullptr;
+        switch (language)
+        {
+        case LanguageType::lua:
+            runner = lua;
+            break;
+        case LanguageType::python:
+            runner = python;
+            break;
+        case LanguageType::javascript:
+            runner = javascript;
+            break;
+        }
+        if (nullptr == runner)
+            return;
+
+        // the runner id is the core's, the packets of the runner carry it back
+        auto runInfo = std::shared_ptr<TaskRunInfo>(new TaskRunInfo{0, 0, userId, taskId, TaskRunStatus::waiting, {name.data(), name.size()}, runnerId});
+        runner(
+            0,
+            userId,
+            taskId,
+            {name.data(), name.size()},
+            {script.data(), script.size()},
+            {passport.data(), passport.size()},
+            {callMethods.data(), callMethods.size()},
+            options,
+            runnerId,
+            runInfo);
+    }
+
+    uint64_t admit(uint32_t clientId, uint32_t requestId, RunDescriptor &&descriptor, Scheduler::Submission &submission)
+    {
+        decltype(&lua) runner = nullptr;
+
+        switch (descriptor.language)
+        {
+        case LanguageType::lua:
+            runner = lua;
+            break;
+        case LanguageType::python:
+            runner = python;
+            break;
+        case LanguageType::javascript:
+            runner = javascript;
+            break;
+        }
+        if (nullptr == runner)
+            return 0;
+
+        auto budgets = descriptor.options;
+        if (std::chrono::milliseconds::zero() == budgets.wallBudget)
+            budgets.wallBudget = g_defaultWallBudget;
+        if (std::chrono::milliseconds::zero() == budgets.cpuBudget)
+            budgets.cpuBudget = g_defaultCpuBudget;
+        if (0 == budgets.memoryLimit)
+            budgets.memoryLimit = g_defaultMemoryLimit;
+
+        // the task is known from now on, while it waits in the scheduler it reports as waiting and can be stopped
+        auto runInfo = std::shared_ptr<TaskRunInfo>(new TaskRunInfo{clientId, requestId, descriptor.userId, descriptor.taskId, TaskRunStatus::waiting, descriptor.name});
+        auto runnerId = registerRunInfo(runInfo);
+
+        submission.userId = descriptor.userId;
+        submission.priority = descriptor.options.priority;
+        submission.task = [runner, budgets, runnerId, runInfo, clientId, descriptor = std::move(descriptor)]
+        {
+            // in the prefork mode a worker process runs the task
+            if (g_processPool.started())
+                process(descriptor.language, clientId, descriptor.userId, descriptor.taskId, descriptor.name, descriptor.script, descriptor.passport, descriptor.callMethods, budgets, runnerId, runInfo);
+            else
+                runner(clientId, descriptor.userId, descriptor.taskId, descriptor.name, descriptor.script, descriptor.passport, descriptor.callMethods, budgets, runnerId, runInfo);
+        };
+
+        return runnerId;
+    }
+
+    uint64_t registerRunInfo(std::shared_ptr<TaskRunInfo> runInfo)
+    {
+        auto &info = *runInfo;
+        info.runnerId = taskRunInfo.insert(std::move(runInfo));
+
+        return info.runnerId;
+    }
+
+    void unregisterRunInfo(uint64_t runnerId)
+    {
+        taskRunInfo.erase(runnerId);
+    }
+
     std::vector<std::string> stringSplitAscii(const std::string_view &str, const std::string_view &delimiter)
     {
         std::vector<std::string> result;
@@ -401,7 +706,7 @@ namespace Service::Detail
 
 namespace Service
 {
-    std::unordered_map<uint64_t, Detail::TaskRunInfo *> taskRunInfo;
+    Registry<Detail::TaskRunInfo> taskRunInfo;
 
     uint64_t run(
         uint32_t clientId,
@@ -411,45 +716,102 @@ namespace Service
         const std::string &name,
         const std::string &script,
         const std::string &passport,
-        const std::string &callMethods)
+        const std::string &callMethods,
+        const run_options_t &options,
+        uint32_t requestId)
     {
-        std::promise<uint64_t> runnerId;
+        Scheduler::Submission submission;
+        auto runnerId = Detail::admit(clientId, requestId, {userId, taskId, language, name, script, passport, callMethods, options}, submission);
+        if (0 == runnerId)
+            return 0;
 
-        switch (language)
+        g_scheduler.submit(submission.userId, submission.priority, std::move(submission.task));
+
+        return runnerId;
+    }
+
+    std::vector<uint64_t> run(uint32_t clientId, std::vector<run_descriptor_t> &&descriptors, uint32_t requestId)
+    {
+        std::vector<uint64_t> runnerIds;
+        std::vector<Scheduler::Submission> submissions;
+        runnerIds.reserve(descriptors.size());
+        submissions.reserve(descriptors.size());
+
+        for (auto &descriptor : descriptors)
         {
-        case language_t::lua:
-            g_threadPool.addRunable(Detail::lua, clientId, userId, taskId, name, script, passport, callMethods, &runnerId);
-            break;
-        case language_t::python:
-            g_threadPool.addRunable(Detail::python, clientId, userId, taskId, name, script, passport, callMethods, &runnerId);
-            break;
-        case language_t::javascript:
-            g_threadPool.addRunable(Detail::javascript, clientId, userId, taskId, name, script, passport, callMethods, &runnerId);
-            break;
+            Scheduler::Submission submission;
+            auto runnerId = Detail::admit(clientId, requestId, std::move(descriptor), submission);
+            if (0 != runnerId)
+                submissions.push_back(std::move(submission));
+
+            runnerIds.push_back(runnerId);
         }
 
-        return runnerId.get_future().get();
+        // one lock and one dispatch of the scheduler for the whole batch
+        if (!submissions.empty())
+            g_scheduler.submit(std::move(submissions));
+
+        return runnerIds;
     }
 
     bool stop(uint64_t runnerId)
     {
-        // !TODO: update thread-pool to support force stop a thread and
-        //         auto-new a thread when the pool's size is not enough
-        return false;
+        auto runInfo = taskRunInfo.find(runnerId);
+        if (nullptr == runInfo)
+            return false;
+
+        // interrupt outside the lock, delivering to python needs the runner's GIL
+        return runInfo->control.interrupt(TaskControl::Reason::cancelled);
     }
 
     task_run_status_t status(uint64_t runnerId)
     {
-        if (!taskRunInfo.contains(runnerId))
+        auto runInfo = taskRunInfo.find(runnerId);
+        if (nullptr == runInfo)
             return task_run_status_t::none;
 
-        return taskRunInfo[runnerId]->status;
+        return runInfo->status;
+    }
+
+    bool prefork(size_t workers)
+    {
+        return g_processPool.start(
+            workers,
+            []
+            {
+                // initialized once here, the workers inherit it
+                PythonVMPool::initialize();
+
+                // a worker runs its task on the thread it was forked on, the threads of the core were not copied
+                g_luaCoroutines = false;
+                g_service.redirect([](yasio::packet_t &&packet)
+                                   { return ProcessPool::reply({packet.data(), packet.size()}) ? 0 : -1; });
+
+                // pooled vms are kept per thread, these are handed to the first task of every worker
+                Detail::TaskRunInfo warmup{0, 0, 0, 0, task_run_status_t::waiting, "warmup"};
+                LuaVMPool::acquire(&warmup);
+                JavascriptVMPool::acquire(&warmup);
+                PythonVMPool::acquire(&warmup);
+            },
+            Detail::serve);
+    }
+
+    invalidate_result_t invalidate(uint64_t userId, uint64_t taskId)
+    {
+        // each worker keeps the warm vms of the tasks it ran, and a busy worker cannot be asked to drop them
+        if (g_processPool.started())
+            return invalidate_result_t::rejected;
+
+        // a task has warm vms of one language only, but it may have changed its language
+        auto lua = LuaVMPool::invalidate(userId, taskId);
+        auto python = PythonVMPool::invalidate(userId, taskId);
+
+        return lua || python ? invalidate_result_t::dropped : invalidate_result_t::none;
     }
 
     void join()
     {
-        while (!taskRunInfo.empty())
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        taskRunInfo.wait();
     }
 
 }
\ No newline at end of file
@@ -136,6 +136,9 @@ int main(int argc, char **args)
     script.assign(std::istreambuf_iterator<char>(scriptFile), std::istreambuf_iterator<char>());
     scriptFile.close();
 
+    if (Service::language_t::python == languageType)
+        PythonVMPool::initialize();
+
     // run script
     Service::run(
         0,
@@ -10,113 +10,122 @@ namespace Service::Detail
         const std::string &script,
         const std::string &passport,
         const std::string &callMethods,
-        std::promise<uint64_t> *runnerId)
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
     {
-        bool result = false;
-        TaskRunInfo runInfo{clientId, userId, taskId, TaskRunStatus::waiting, name};
-
-        // create lua vm
-        lua_State *luaState = luaL_newstate();
-        if (nullptr == luaState)
+        // the run outlives this call when the task suspends in a builtin
+        struct Run
         {
-            ModuleTools::Logger::failed({"create lua vm failed"}, &runInfo);
-            runnerId->set_value(0);
+            LuaVMPool::Lease vm;
+            std::optional<StickyTicket> ticket;
+            bool result = false;
+        };
 
-            return result;
-        }
-        taskRunInfo.emplace(reinterpret_cast<uint64_t>(luaState), &runInfo);
+        auto &runInfo = *runInfoHolder;
 
-        // construction finally block
-        finally
-        {
-            runInfo.status = TaskRunStatus::finished;
+        // sticky tasks resume their warm vm, which still has the script loaded and the passport set
+        std::optional<StickyTicket> ticket;
+        if (std::chrono::milliseconds::zero() < options.stickyTtl)
+            ticket = StickyTicket{userId, taskId, ModuleCrypto::sha256(script + '\0' + passport), options.stickyTtl};
 
-            if (result)
-                ModuleTools::Logger::succeed({"lua execute success"}, &runInfo);
-            else
-                ModuleTools::Logger::failed({"lua execute failed"}, &runInfo);
+        // acquire a pooled lua vm
+        auto vm = LuaVMPool::acquire(&runInfo, ticket.has_value() ? &*ticket : nullptr);
+        lua_State *luaState = vm.state();
 
-            lua_close(luaState);
-            taskRunInfo.erase(reinterpret_cast<uint64_t>(luaState));
-        };
+        // report the result once the last holder lets go, on whichever thread the task finished
+        auto run = std::shared_ptr<Run>(
+            new Run{std::move(vm), std::move(ticket)},
+            [=](Run *run)
+            {
+                auto &runInfo = *runInfoHolder;
+
+                runInfo.status = TaskRunStatus::finished;
+
+                if (run->result)
+                    ModuleTools::Logger::succeed({"lua execute success"}, &runInfo);
+                else
+                    ModuleTools::Logger::failed({"lua execute failed"}, &runInfo);
 
-        // initialization environment
-        luaL_openlibs(luaState);
+                // the vm goes back to the pool when the lease ends
+                if (nullptr != luaState)
+                {
+                    runInfo.control.unbind(luaState);
+                    if (TaskControl::Reason::memoryLimit == runInfo.control.reason())
+                        run->vm.discard();
+                }
+                unregisterRunInfo(runnerId);
 
-        // register modules
-        ModuleCrypto::bind(luaState);
-        ModuleJson::bind(luaState);
-        ModuleRequests::bind(luaState);
-        ModuleTools::bind(luaState, &runInfo);
-        ModuleSystem::bind(luaState);
+                delete run;
+            });
 
-        // notify runnerId
-        runnerId->set_value(reinterpret_cast<uint64_t>(luaState));
+        if (nullptr == luaState)
+        {
+            ModuleTools::Logger::failed({"create lua vm failed"}, &runInfo);
 
-        // load sciprt environment
-        if (LUA_OK != luaL_dostring(luaState, script.c_str()))
+            return false;
+        }
+        run->vm.allocator().arm(options.memoryLimit, &runInfo.control);
+
+        // install interrupt checks
+        TaskControl::Scope controlScope(&runInfo.control);
+        runInfo.control.setBudget(options.wallBudget, options.cpuBudget);
+        runInfo.control.bind(luaState);
+
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return false;
+
+        // the runner runs the chunk, setTaskPassport and the methods, a warm vm skips the first two
+        LuaVMPool::pushRunner(luaState);
+        if (run->vm.warm())
+            lua_pushnil(luaState);
+        else if (LUA_OK != LuaVMPool::load(luaState, script))
         {
             ModuleTools::Logger::failed({lua_tostring(luaState, -1)}, &runInfo);
+            lua_settop(luaState, 0);
 
-            return result;
+            return false;
         }
+        lua_pushstring(luaState, passport.c_str());
 
-        runInfo.status = TaskRunStatus::running;
         auto methods = stringSplitAscii(callMethods, ",");
-        for (size_t i = 0; i < methods.size() + 1; i++)
+        if (!lua_checkstack(luaState, static_cast<int>(methods.size())))
         {
-            // get target method
-            lua_getglobal(luaState, 0 == i ? "setTaskPassport" : methods[i - 1].c_str());
-            // check target value if is not a function
-            if (!lua_isfunction(luaState, -1))
-            {
-                ModuleTools::Logger::failed(
-                    {
-                        0 == i ? "setTaskPassport" : methods[i - 1],
-                        "is not a function",
-                    },
-                    &runInfo);
+            ModuleTools::Logger::failed({"too many methods"}, &runInfo);
+            lua_settop(luaState, 0);
 
-                return result;
-            }
-
-            // call target method
-            bool isCallSucceed = false;
-            if (0 == i)
-            {
-                lua_pushstring(luaState, passport.c_str());
-                isCallSucceed = LUA_OK == lua_pcall(luaState, 1, 1, 0);
-            }
-            else
-                isCallSucceed = LUA_OK == lua_pcall(luaState, 0, 1, 0);
+            return false;
+        }
+        for (auto &method : methods)
+            lua_pushstring(luaState, method.c_str());
 
-            // check call result
-            if (!isCallSucceed)
+        // as a coroutine, builtins which wait suspend the task and give this thread back
+        runInfo.status = TaskRunStatus::running;
+        LuaCoroutine::start(
+            luaState,
+            static_cast<int>(methods.size()) + 2,
+            &runInfo.control,
+            [run, runInfoHolder](int status, lua_State *thread)
             {
-                ModuleTools::Logger::failed({lua_tostring(luaState, -1)}, &runInfo);
+                auto &runInfo = *runInfoHolder;
 
-                return false;
-            }
-            else if (0 != i)
-            {
-                if (!lua_isboolean(luaState, -1))
+                if (LUA_OK != status)
+                    ModuleTools::Logger::failed({lua_tostring(thread, -1)}, &runInfo);
+                else if (lua_isnil(thread, 1))
+                    ModuleTools::Logger::failed({lua_tostring(thread, 2), lua_tostring(thread, 3)}, &runInfo);
+                else
                 {
-                    ModuleTools::Logger::failed(
-                        {
-                            methods[i - 1],
-                            "return value is not a boolean",
-                        },
-                        &runInfo);
+                    run->result = lua_toboolean(thread, 1);
 
-                    return result;
+                    // a completed run keeps its vm warm for the next one
+                    if (run->ticket.has_value())
+                        run->vm.stick();
                 }
+            });
 
-                result = lua_toboolean(luaState, -1);
-                lua_pop(luaState, 1);
-            }
-        }
-
-        return result;
+        // the result is reported by the deleter of the run, maybe from another thread
+        return true;
     }
 
     bool python(
@@ -127,19 +136,41 @@ namespace Service::Detail
         const std::string &script,
         const std::string &passport,
         const std::string &callMethods,
-        std::promise<uint64_t> *runnerId)
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
     {
         bool result = false;
-        TaskRunInfo runInfo{clientId, userId, taskId, TaskRunStatus::waiting, name};
+        auto &runInfo = *runInfoHolder;
+
+        // sticky tasks resume their warm vm, which still has the script loaded and the passport set
+        std::optional<StickyTicket> ticket;
+        if (std::chrono::milliseconds::zero() < options.stickyTtl)
+            ticket = StickyTicket{userId, taskId, ModuleCrypto::sha256(script + '\0' + passport), options.stickyTtl};
 
-        // create python vm
-        Py_Initialize();
+        // acquire a pooled python interpreter, its gil is held until the lease ends
+        auto vm = PythonVMPool::acquire(&runInfo, ticket.has_value() ? &*ticket : nullptr);
         PyObject *mainModule, *globalDict;
-        mainModule = PyImport_AddModule("__main__");
+        mainModule = vm.mainModule();
+
+        // construction finally block
+        finally
+        {
+            runInfo.status = TaskRunStatus::finished;
+
+            if (result)
+                ModuleTools::Logger::succeed({"python execute success"}, &runInfo);
+            else
+                ModuleTools::Logger::failed({"python execute failed"}, &runInfo);
+
+            // the interpreter is reset and goes back to the pool when the lease ends
+            runInfo.control.unbindPython();
+            unregisterRunInfo(runnerId);
+        };
+
         if (nullptr == mainModule)
         {
             ModuleTools::Logger::failed({"create python vm failed"}, &runInfo);
-            runnerId->set_value(0);
 
             return result;
         }
@@ -147,50 +178,38 @@ namespace Service::Detail
         if (nullptr == globalDict)
         {
             ModuleTools::Logger::failed({"get python structure failed"}, &runInfo);
-            runnerId->set_value(0);
 
             return result;
         }
-        taskRunInfo.emplace(reinterpret_cast<uint64_t>(mainModule), &runInfo);
-
-        // construction finally block
-        finally
-        {
-            runInfo.status = TaskRunStatus::finished;
-
-            if (result)
-                ModuleTools::Logger::succeed({"python execute success"}, &runInfo);
-            else
-                ModuleTools::Logger::failed({"python execute failed"}, &runInfo);
 
-            Py_Finalize();
-            taskRunInfo.erase(reinterpret_cast<uint64_t>(mainModule));
-        };
-
-        // register modules
-        ModuleCrypto::bind(mainModule);
-        ModuleJson::bind(mainModule);
-        ModuleRequests::bind(mainModule);
-        ModuleTools::bind(mainModule, &runInfo);
-        ModuleSystem::bind(mainModule);
+        // install interrupt delivery
+        TaskControl::Scope controlScope(&runInfo.control);
+        runInfo.control.setBudget(options.wallBudget, options.cpuBudget);
+        runInfo.control.bindPython();
 
-        // notify runnerId
-        runnerId->set_value(reinterpret_cast<uint64_t>(mainModule));
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return result;
 
         try
         {
             // load sciprt environment
-            if (nullptr == PyRun_String(script.c_str(), Py_file_input, globalDict, globalDict))
+            if (!vm.warm())
             {
-                ModuleTools::Logger::failed({pybind11::cast<std::string>(pybind11::error_scope().value)}, &runInfo);
+                auto loadResult = vm.run(script);
+                if (nullptr == loadResult)
+                {
+                    ModuleTools::Logger::failed({pybind11::cast<std::string>(pybind11::error_scope().value)}, &runInfo);
 
-                return result;
+                    return result;
+                }
+                Py_DECREF(loadResult);
             }
 
             runInfo.status = TaskRunStatus::running;
             auto methods = stringSplitAscii(callMethods, ",");
 
-            for (int i = 0; i < methods.size() + 1; i++)
+            for (int i = vm.warm() ? 1 : 0; i < methods.size() + 1; i++)
             {
                 if (0 == i)
                     pybind11::getattr(mainModule, "setTaskPassport")(passport);
@@ -201,6 +220,10 @@ namespace Service::Detail
                     result = pybind11::cast<bool>(callResult);
                 }
             }
+
+            // a completed run keeps its interpreter warm for the next one
+            if (ticket.has_value())
+                vm.stick();
         }
         catch (const std::exception &e)
         {
@@ -220,29 +243,17 @@ namespace Service::Detail
         const std::string &script,
         const std::string &passport,
         const std::string &callMethods,
-        std::promise<uint64_t> *runnerId)
+        const RunOptions &options,
+        uint64_t runnerId,
+        const std::shared_ptr<TaskRunInfo> &runInfoHolder)
     {
         bool result = false;
-        TaskRunInfo runInfo{clientId, userId, taskId, TaskRunStatus::waiting, name};
-
-        // create javascript vm
-        auto runtime = JS_NewRuntime();
-        if (nullptr == runtime)
-        {
-            ModuleTools::Logger::failed({"create javascript vm failed"}, &runInfo);
-            runnerId->set_value(0);
-
-            return result;
-        }
-        auto context = JS_NewContext(runtime);
-        if (nullptr == context)
-        {
-            ModuleTools::Logger::failed({"create javascript context failed"}, &runInfo);
-            runnerId->set_value(0);
+        auto &runInfo = *runInfoHolder;
 
-            return result;
-        }
-        taskRunInfo.emplace(reinterpret_cast<uint64_t>(context), &runInfo);
+        // acquire a pooled javascript runtime with a fresh context
+        auto vm = JavascriptVMPool::acquire(&runInfo);
+        auto runtime = vm.runtime();
+        auto context = vm.context();
 
         // construction finally block
         finally
@@ -254,31 +265,53 @@ namespace Service::Detail
             else
                 ModuleTools::Logger::failed({"javascript execute failed"}, &runInfo);
 
-            JS_FreeContext(context);
-            JS_FreeRuntime(runtime);
-            taskRunInfo.erase(reinterpret_cast<uint64_t>(context));
+            // the context is freed and the runtime goes back to the pool when the lease ends
+            if (nullptr != runtime)
+            {
+                runInfo.control.unbind(runtime);
+                if (TaskControl::Reason::memoryLimit == runInfo.control.reason())
+                    vm.discard();
+            }
+            unregisterRunInfo(runnerId);
         };
 
-        // register modules
-        ModuleCrypto::bind(context);
-        ModuleJson::bind(context);
-        ModuleRequests::bind(context);
-        ModuleTools::bind(context, &runInfo);
-        ModuleSystem::bind(context);
+        if (nullptr == runtime)
+        {
+            ModuleTools::Logger::failed({"create javascript vm failed"}, &runInfo);
+
+            return result;
+        }
+        if (nullptr == context)
+        {
+            ModuleTools::Logger::failed({"create javascript context failed"}, &runInfo);
+
+            return result;
+        }
+        vm.allocator().arm(options.memoryLimit, &runInfo.control);
+
+        // install interrupt checks
+        TaskControl::Scope controlScope(&runInfo.control);
+        runInfo.control.setBudget(options.wallBudget, options.cpuBudget);
+        runInfo.control.bind(runtime);
 
-        // notify runnerId
-        runnerId->set_value(reinterpret_cast<uint64_t>(context));
+        // cancelled while it was queued
+        if (runInfo.control.interrupted())
+            return result;
 
         // load sciprt environment
-        auto loadResult = JS_Eval(context, script.c_str(), script.size(), "<input>", JS_EVAL_TYPE_GLOBAL);
+        auto loadResult = JavascriptVMPool::eval(context, script);
         if (JS_IsException(loadResult))
         {
             auto exception = JS_GetException(context);
-            ModuleTools::Logger::failed({JS_ToCString(context, exception)}, &runInfo);
+            auto message = JS_ToCString(context, exception);
+            ModuleTools::Logger::failed({nullptr == message ? "" : message}, &runInfo);
+            JS_FreeCString(context, message);
             JS_FreeValue(context, exception);
 
             return result;
         }
+        // the runtime outlives this task, values must not leak into it
+        JS_FreeValue(context, loadResult);
 
         runInfo.status = TaskRunStatus::running;
         auto methods = stringSplitAscii(callMethods, ",");
@@ -304,6 +337,7 @@ namespace Service::Detail
             {
                 auto args = JS_NewString(context, passport.c_str());
                 callResult = JS_Call(context, targetFunction, globalThis, 1, &args);
+                JS_FreeValue(context, args);
             }
             else
                 callResult = JS_Call(context, targetFunction, globalThis, 0, nullptr);
@@ -313,7 +347,9 @@ namespace Service::Detail
             if (JS_IsException(callResult))
             {
                 auto exception = JS_GetException(context);
-                ModuleTools::Logger::failed({JS_ToCString(context, exception)}, &runInfo);
+                auto message = JS_ToCString(context, exception);
+                ModuleTools::Logger::failed({nullptr == message ? "" : message}, &runInfo);
+                JS_FreeCString(context, message);
                 JS_FreeValue(context, exception);
 
                 return result;
@@ -329,11 +365,14 @@ namespace Service::Detail
                         },
                         &runInfo);
 
+                    JS_FreeValue(context, callResult);
+
                     return result;
                 }
 
                 result = JS_ToBool(context, callResult);
             }
+            JS_FreeValue(context, callResult);
         }
 
         // execute remaining jobs
@@ -342,6 +381,19 @@ namespace Service::Detail
         return true;
     }
 
+    uint64_t registerRunInfo(std::shared_ptr<TaskRunInfo> runInfo)
+    {
+        auto &info = *runInfo;
+        info.runnerId = taskRunInfo.insert(std::move(runInfo));
+
+        return info.runnerId;
+    }
+
+    void unregisterRunInfo(uint64_t runnerId)
+    {
+        taskRunInfo.erase(runnerId);
+    }
+
     std::vector<std::string> stringSplitAscii(const std::string_view &str, const std::string_view &delimiter)
     {
         std::vector<std::string> result;
@@ -378,7 +430,7 @@ namespace Service::Detail
 
 namespace Service
 {
-    std::unordered_map<uint64_t, Detail::TaskRunInfo *> taskRunInfo;
+    Registry<Detail::TaskRunInfo> taskRunInfo;
 
     uint64_t run(
         uint32_t clientId,
@@ -388,45 +440,79 @@ namespace Service
         const std::string &name,
         const std::string &script,
         const std::string &passport,
-        const std::string &callMethods)
+        const std::string &callMethods,
+        const run_options_t &options,
+        uint32_t requestId)
     {
-        std::promise<uint64_t> runnerId;
+        decltype(&Detail::lua) runner = nullptr;
 
         switch (language)
         {
         case language_t::lua:
-            g_threadPool.addRunable(Detail::lua, clientId, userId, taskId, name, script, passport, callMethods, &runnerId);
+            runner = Detail::lua;
             break;
         case language_t::python:
-            g_threadPool.addRunable(Detail::python, clientId, userId, taskId, name, script, passport, callMethods, &runnerId);
+            runner = Detail::python;
             break;
         case language_t::javascript:
-            g_threadPool.addRunable(Detail::javascript, clientId, userId, taskId, name, script, passport, callMethods, &runnerId);
+            runner = Detail::javascript;
             break;
         }
-
-        return runnerId.get_future().get();
+        if (nullptr == runner)
+            return 0;
+
+        auto budgets = options;
+        if (std::chrono::milliseconds::zero() == budgets.wallBudget)
+            budgets.wallBudget = g_defaultWallBudget;
+        if (std::chrono::milliseconds::zero() == budgets.cpuBudget)
+            budgets.cpuBudget = g_defaultCpuBudget;
+        if (0 == budgets.memoryLimit)
+            budgets.memoryLimit = g_defaultMemoryLimit;
+
+        // the task is known from now on, while it waits in the scheduler it reports as waiting and can be stopped
+        auto runInfo = std::shared_ptr<Detail::TaskRunInfo>(new Detail::TaskRunInfo{clientId, requestId, userId, taskId, task_run_status_t::waiting, name});
+        auto runnerId = Detail::registerRunInfo(runInfo);
+
+        g_scheduler.submit(
+            userId,
+            options.priority,
+            [=]
+            { runner(clientId, userId, taskId, name, script, passport, callMethods, budgets, runnerId, runInfo); });
+
+        return runnerId;
     }
 
     bool stop(uint64_t runnerId)
     {
-        // !TODO: update thread-pool to support force stop a thread and
-        //         auto-new a thread when the pool's size is not enough
-        return false;
+        auto runInfo = taskRunInfo.find(runnerId);
+        if (nullptr == runInfo)
+            return false;
+
+        // interrupt outside the lock, delivering to python needs the runner's GIL
+        return runInfo->control.interrupt(TaskControl::Reason::cancelled);
     }
 
     task_run_status_t status(uint64_t runnerId)
     {
-        if (!taskRunInfo.contains(runnerId))
+        auto runInfo = taskRunInfo.find(runnerId);
+        if (nullptr == runInfo)
             return task_run_status_t::none;
 
-        return taskRunInfo[runnerId]->status;
+        return runInfo->status;
+    }
+
+    invalidate_result_t invalidate(uint64_t userId, uint64_t taskId)
+    {
+        // a task has warm vms of one language only, but it may have changed its language
+        auto lua = LuaVMPool::invalidate(userId, taskId);
+        auto python = PythonVMPool::invalidate(userId, taskId);
+
+        return lua || python ? invalidate_result_t::dropped : invalidate_result_t::none;
     }
 
     void join()
     {
-        while (!taskRunInfo.empty())
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        taskRunInfo.wait();
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "service.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    // no more than the smallest thread pool, so every task gets a thread of its own
+    constexpr uint64_t taskCount = 4;
+
+    // the delay of tests/concurrency.py
+    constexpr auto taskDelay = std::chrono::milliseconds(1000);
+
+    struct Times
+    {
+        std::chrono::steady_clock::time_point begin;
+        std::chrono::steady_clock::time_point end;
+        bool succeed = false;
+    };
+
+    int failures = 0;
+
+    void check(bool condition, const char *what)
+    {
+        std::printf("[%s] %s\n", condition ? "ok" : "failed", what);
+        if (!condition)
+            failures++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (2 > argc)
+    {
+        std::printf("Usage: test_concurrency tests/concurrency.py\n");
+        return 1;
+    }
+
+    std::ifstream scriptFile(argv[1]);
+    if (!scriptFile.is_open())
+    {
+        std::printf("failed to open %s\n", argv[1]);
+        return 1;
+    }
+    std::string script(std::istreambuf_iterator<char>(scriptFile), {});
+
+    // the tasks log when they begin and end, the times are taken here so every task is measured by the same clock
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Times> times;
+    ModuleTools::logger = [&](ModuleTools::log_t logType, const std::string_view &message, void *userData)
+    {
+        auto taskRunInfo = static_cast<Service::task_run_info_t *>(userData);
+        auto now = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> locker(mutex);
+
+        auto &task = times[taskRunInfo->taskId];
+        if (ModuleTools::log_t::succeed == logType)
+            task.succeed = true;
+        else if (0 == message.find("begin"))
+            task.begin = now;
+        else if (0 == message.find("end"))
+            task.end = now;
+    };
+
+    PythonVMPool::initialize();
+
+    // separate users, so the scheduler does not hold any task back for fairness
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 1; i <= taskCount; i++)
+        Service::run(0, i, i, Service::language_t::python, "concurrency", script, "", "main");
+
+    Service::join();
+    auto elapsed = std::chrono::steady_clock::now() - begin;
+
+    auto latestBegin = std::chrono::steady_clock::time_point::min();
+    auto earliestEnd = std::chrono::steady_clock::time_point::max();
+    bool succeed = taskCount == times.size();
+    for (const auto &[taskId, task] : times)
+    {
+        succeed = succeed && task.succeed;
+        latestBegin = std::max(latestBegin, task.begin);
+        earliestEnd = std::min(earliestEnd, task.end);
+    }
+
+    std::printf(
+        "%llu tasks of %lld ms took %lld ms\n",
+        static_cast<unsigned long long>(taskCount),
+        static_cast<long long>(taskDelay.count()),
+        static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()));
+
+    check(succeed, "every task succeeded");
+    // every task began before any of them ended, so all of them were running at once
+    check(latestBegin < earliestEnd, "the tasks overlap");
+    check(elapsed < taskDelay * 2, "the tasks took about one delay");
+
+    return 0 == failures ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+# one of the tasks submitted by tests/concurrency.cc, which checks that the runs overlap
+def setTaskPassport(passport):
+    pass
+
+def main():
+    logger.info('begin')
+
+    # the delay releases the gil, the other tasks run meanwhile
+    system.delay(1000)
+
+    logger.info('end')
+
+    return True
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "NetworkService.h"
+
+#include <yasio/yasio/xxsocket.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    // off the port of a core which may be running on the same machine
+    constexpr uint16_t servicePort = 16889;
+
+    constexpr size_t clientThreads = 8;
+    constexpr size_t connections = 50;
+    constexpr size_t framesPerConnection = 8;
+
+    constexpr auto timeout = std::chrono::seconds(5);
+
+    int failures = 0;
+
+    void check(bool condition, const char *what)
+    {
+        std::printf("[%s] %s\n", condition ? "ok" : "failed", what);
+        if (!condition)
+            failures++;
+    }
+
+    yasio::obstream handshake(bool compression)
+    {
+        yasio::obstream obs;
+        auto packetSize = obs.push<uint32_t>();
+        obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::handshake));
+        obs.write_v32(std::string_view(g_serviceKey));
+        obs.write_byte(NetworkService::protocolRevision);
+        obs.write_byte(compression ? NetworkService::capabilities : uint8_t(0));
+        obs.pop<uint32_t>(packetSize);
+
+        return obs;
+    }
+
+    yasio::obstream status(uint32_t requestId)
+    {
+        yasio::obstream obs;
+        auto packetSize = obs.push<uint32_t>();
+        obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::status));
+        obs.write<uint32_t>(requestId);
+        obs.write<uint64_t>(requestId);
+        obs.pop<uint32_t>(packetSize);
+
+        return obs;
+    }
+
+    // connect, handshake and send a few frames, then disconnect without waiting for replies other than the handshake
+    bool session(bool compression)
+    {
+        yasio::xxsocket socket;
+        if (0 != socket.xpconnect_n(g_serviceAddress, servicePort, timeout))
+            return false;
+
+        auto request = handshake(compression);
+        if (0 >= socket.send_n(request.buffer().data(), static_cast<int>(request.buffer().size()), timeout))
+            return false;
+
+        // size, command, accepted, revision and capabilities
+        char reply[8];
+        if (static_cast<int>(sizeof(reply)) != socket.recv_n(reply, sizeof(reply), timeout))
+            return false;
+        if (static_cast<uint8_t>(NetworkService::command_t::handshake) != reply[4] || 1 != reply[5])
+            return false;
+
+        for (uint32_t i = 0; i < framesPerConnection; i++)
+        {
+            auto frame = status(i);
+            socket.send_n(frame.buffer().data(), static_cast<int>(frame.buffer().size()), timeout);
+        }
+
+        socket.close();
+
+        return true;
+    }
+}
+
+int main()
+{
+    // never destroyed, packets of closed connections may still be queued in g_threadPool when the test ends
+    auto &service = *new NetworkService(g_serviceAddress, servicePort);
+
+    std::atomic<bool> running = true;
+    std::atomic<size_t> handled = 0;
+
+    // clients which sent a frame, backward(...) keeps writing to them while they connect and disconnect
+    std::mutex clientsMutex;
+    std::unordered_set<uint32_t> clients;
+
+    service.addEventHandler(
+        NetworkService::command_t::status,
+        [&](uint32_t clientId, uint32_t requestId, yasio::ibstream_view &ibs)
+        {
+            handled++;
+
+            std::unique_lock<std::mutex> locker(clientsMutex);
+            clients.insert(clientId);
+        });
+
+    // handlers and callbacks come and go while the packets are dispatched
+    std::thread listeners(
+        [&]
+        {
+            while (running)
+            {
+                auto handlerId = service.addEventHandler(
+                    NetworkService::command_t::status,
+                    [](uint32_t, uint32_t, yasio::ibstream_view &ibs)
+                    { ibs.read<uint64_t>(); });
+                service.addEventCallback(
+                    NetworkService::command_t::status,
+                    [](uint32_t, uint32_t, yasio::ibstream_view &ibs)
+                    { ibs.read<uint64_t>(); });
+                service.removeEventHandler(NetworkService::command_t::status, handlerId);
+            }
+        });
+
+    // large enough to be compressed for the clients which agreed on it
+    std::thread backward(
+        [&]
+        {
+            std::string message(g_compressionThreshold + 64, 'x');
+
+            while (running)
+            {
+                std::vector<uint32_t> targets;
+                {
+                    std::unique_lock<std::mutex> locker(clientsMutex);
+                    targets.assign(clients.begin(), clients.end());
+                }
+
+                for (auto clientId : targets)
+                {
+                    service.revision(clientId);
+
+                    yasio::obstream obs;
+                    auto packetSize = obs.push<uint32_t>();
+                    obs.write_byte(static_cast<uint8_t>(NetworkService::command_t::log));
+                    obs.write_v32(message);
+                    obs.pop<uint32_t>(packetSize);
+
+                    service.backward(clientId, std::move(obs.buffer()), 1);
+                }
+
+                std::this_thread::yield();
+            }
+        });
+
+    std::atomic<size_t> sessions = 0;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clientThreads; i++)
+        threads.emplace_back(
+            [&sessions, i]
+            {
+                for (size_t j = 0; j < connections; j++)
+                    if (session(0 == (i + j) % 2))
+                        sessions++;
+            });
+
+    for (auto &thread : threads)
+        thread.join();
+
+    // let the last frames be dispatched before the writers stop
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    running = false;
+    listeners.join();
+    backward.join();
+
+    check(clientThreads * connections == sessions, "every client was handshaked");
+    check(0 < handled, "the frames of the clients were dispatched");
+
+    return 0 == failures ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "TaskControl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    // the loop is hot enough to be compiled into a trace within milliseconds if the jit were on
+    constexpr const char *tightLoop = "local i = 0 while true do i = i + 1 end";
+
+    // scripts wrap calls in pcall, which must not swallow the interrupt
+    constexpr const char *pcallLoop = "while true do pcall(function() while true do end end) end";
+
+    int failures = 0;
+
+    void check(bool condition, const char *what)
+    {
+        std::printf("[%s] %s\n", condition ? "ok" : "failed", what);
+        if (!condition)
+            failures++;
+    }
+
+    // run `script` under `control` and return the pcall status
+    int run(TaskControl &control, const char *script)
+    {
+        auto luaState = luaL_newstate();
+        luaL_openlibs(luaState);
+        // as with g_luaJit off, compiled traces would never reach the hook
+        luaJIT_setmode(luaState, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+
+        TaskControl::Scope controlScope(&control);
+        control.bind(luaState);
+
+        luaL_loadstring(luaState, script);
+        auto status = lua_pcall(luaState, 0, 0, 0);
+
+        control.unbind(luaState);
+        lua_close(luaState);
+
+        return status;
+    }
+}
+
+int main()
+{
+    {
+        TaskControl control;
+        std::thread stopper([&control]
+                            {
+                                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                                control.interrupt(TaskControl::Reason::cancelled);
+                            });
+
+        auto status = run(control, tightLoop);
+        stopper.join();
+
+        check(0 != status && TaskControl::Reason::cancelled == control.reason(), "a tight loop is stopped");
+    }
+
+    {
+        TaskControl control;
+        control.setBudget(std::chrono::milliseconds::zero(), std::chrono::milliseconds(200));
+
+        auto status = run(control, tightLoop);
+
+        check(0 != status && TaskControl::Reason::cpuTimeout == control.reason(), "a tight loop ends with cpuTimeout");
+    }
+
+    {
+        TaskControl control;
+        control.setBudget(std::chrono::milliseconds(200), std::chrono::milliseconds::zero());
+
+        auto status = run(control, tightLoop);
+
+        check(0 != status && TaskControl::Reason::wallTimeout == control.reason(), "a tight loop ends with wallTimeout");
+    }
+
+    {
+        TaskControl control;
+        control.setBudget(std::chrono::milliseconds(200), std::chrono::milliseconds::zero());
+
+        auto status = run(control, pcallLoop);
+
+        check(0 != status && TaskControl::Reason::wallTimeout == control.reason(), "pcall does not catch the interrupt");
+    }
+
+    return 0 == failures ? 0 : 1;
+}
\ No newline at end of file